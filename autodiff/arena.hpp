@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace autodiff {
+namespace base {
+
+// A bump-pointer region for expression nodes. While an arena is active
+// on a thread, every node the var operators create on that thread is
+// carved out of it, and freeing a node is a no-op. reset() rewinds the
+// region in O(1) and keeps its blocks for the next graph; it must only
+// be called once no expression built from the region is alive any more.
+// Variables keep their own nodes on the heap, so they may outlive it.
+class arena {
+public:
+    // Makes an arena the active one on this thread for its lifetime and
+    // restores the previously active arena afterwards.
+    class scope {
+    public:
+        explicit scope(arena& a) : previous_(slot()) { slot() = &a; }
+        ~scope() { slot() = previous_; }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        arena* previous_;
+    };
+
+    explicit arena(std::size_t block_size = 64 * 1024)
+        : block_size_(block_size) {}
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    static arena* active() { return slot(); }
+
+    void* allocate(std::size_t n, std::size_t align) {
+        while (current_ < blocks_.size()) {
+            block& b = blocks_[current_];
+            std::size_t start = (offset_ + align - 1) & ~(align - 1);
+            if (start + n <= b.size) {
+                offset_ = start + n;
+                used_ += n;
+                return b.data.get() + start;
+            }
+            ++current_;
+            offset_ = 0;
+        }
+        std::size_t size = std::max(block_size_, n + align);
+        blocks_.push_back(block{std::make_unique<std::byte[]>(size), size});
+        return allocate(n, align);
+    }
+
+    void reset() {
+        current_ = 0;
+        offset_ = 0;
+        used_ = 0;
+    }
+
+    // Bytes handed out since the last reset.
+    std::size_t used() const { return used_; }
+
+    // Bytes held by the arena, including free space.
+    std::size_t capacity() const {
+        std::size_t n = 0;
+        for (const auto& b : blocks_) n += b.size;
+        return n;
+    }
+
+private:
+    struct block {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size;
+    };
+
+    static arena*& slot() {
+        static thread_local arena* active = nullptr;
+        return active;
+    }
+
+    std::size_t block_size_;
+    std::vector<block> blocks_;
+    std::size_t current_ = 0;
+    std::size_t offset_ = 0;
+    std::size_t used_ = 0;
+};
+
+// Standard allocator drawing from an arena, for std::allocate_shared.
+template <typename T>
+class arena_allocator {
+public:
+    using value_type = T;
+
+    explicit arena_allocator(arena& a) : arena_(&a) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) : arena_(other.get()) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, std::size_t) {}
+
+    arena* get() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& other) const {
+        return arena_ == other.get();
+    }
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& other) const {
+        return arena_ != other.get();
+    }
+
+private:
+    arena* arena_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "pool.hpp"
+#include "var.hpp"
+
+namespace autodiff {
+namespace base {
+
+// Evaluates one recorded graph at many input points at once. Values and
+// adjoints are stored structure-of-arrays: every record of the tape owns
+// a column of width() entries, one per point, and each pass dispatches
+// once per record and then runs a plain loop down its column.
+//
+// The tape itself is only read, so any number of batches may share it.
+class batch {
+public:
+    batch(const tape& t, tape::index head, std::size_t width)
+        : tape_(&t), head_(t.position(head)), width_(width),
+          values_((static_cast<std::size_t>(head_) + 1) * width) {
+        // until the caller fills them in, inputs and constants hold the
+        // values they were recorded with
+        for (tape::index i = 0; i <= head_; ++i) {
+            const record& r = (*tape_)[i];
+            if (r.op == opcode::variable || r.op == opcode::constant) {
+                double* v = column(values_, i);
+                for (std::size_t k = 0; k < width_; ++k) v[k] = r.value;
+            }
+        }
+    }
+
+    batch(const var& head, std::size_t width)
+        : batch(recorded_on(head), head.get_index(), width) {}
+
+    std::size_t width() const { return width_; }
+
+    // The column of x: write the input points of a variable here before
+    // forward(), read the results of any node after it.
+    double* values(const var& x) { return column(values_, index_of(x)); }
+    const double* values(const var& x) const {
+        return column(values_, index_of(x));
+    }
+
+    // The column of d head / d x, valid after backward().
+    const double* adjoints(const var& x) const {
+        return column(adjoints_, index_of(x));
+    }
+
+    void forward() {
+        const tape& t = *tape_;
+        for (tape::index i = 0; i <= head_; ++i) {
+            const record& r = t[i];
+            double* v = column(values_, i);
+            const double* l = column(values_, r.lhs);
+            const double* d = column(values_, r.rhs);
+            const std::size_t n = width_;
+            switch (r.op) {
+                case opcode::add:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = l[k] + d[k];
+                    break;
+                case opcode::sub:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = l[k] - d[k];
+                    break;
+                case opcode::mul:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = l[k] * d[k];
+                    break;
+                case opcode::div:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = l[k] / d[k];
+                    break;
+                case opcode::neg:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = -l[k];
+                    break;
+                case opcode::exp:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = std::exp(l[k]);
+                    break;
+                case opcode::sin:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = std::sin(l[k]);
+                    break;
+                case opcode::cos:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = std::cos(l[k]);
+                    break;
+                case opcode::ln:
+                    for (std::size_t k = 0; k < n; ++k) v[k] = std::log(l[k]);
+                    break;
+                case opcode::log:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        v[k] = std::log(l[k]) / std::log(2);
+                    }
+                    break;
+                case opcode::pow:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        v[k] = std::pow(l[k], d[k]);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Reverse sweep seeded with 1 at head in every column.
+    void backward() {
+        const tape& t = *tape_;
+        adjoints_.assign(values_.size(), 0.0);
+        double* h = column(adjoints_, head_);
+        for (std::size_t k = 0; k < width_; ++k) h[k] = 1.0;
+        for (tape::index i = head_ + 1; i-- > 0;) {
+            const record& r = t[i];
+            const double* a = column(adjoints_, i);
+            const double* v = column(values_, i);
+            const double* l = column(values_, r.lhs);
+            const double* d = column(values_, r.rhs);
+            double* al = column(adjoints_, r.lhs);
+            double* ar = column(adjoints_, r.rhs);
+            const std::size_t n = width_;
+            switch (r.op) {
+                case opcode::add:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k];
+                        ar[k] += a[k];
+                    }
+                    break;
+                case opcode::sub:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k];
+                        ar[k] -= a[k];
+                    }
+                    break;
+                case opcode::mul:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k] * d[k];
+                        ar[k] += a[k] * l[k];
+                    }
+                    break;
+                case opcode::div:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k] / d[k];
+                        ar[k] -= a[k] * l[k] / (d[k] * d[k]);
+                    }
+                    break;
+                case opcode::neg:
+                    for (std::size_t k = 0; k < n; ++k) al[k] -= a[k];
+                    break;
+                case opcode::exp:
+                    for (std::size_t k = 0; k < n; ++k) al[k] += a[k] * v[k];
+                    break;
+                case opcode::sin:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k] * std::cos(l[k]);
+                    }
+                    break;
+                case opcode::cos:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] -= a[k] * std::sin(l[k]);
+                    }
+                    break;
+                case opcode::ln:
+                    for (std::size_t k = 0; k < n; ++k) al[k] += a[k] / l[k];
+                    break;
+                case opcode::log:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k] / (l[k] * std::log(2));
+                    }
+                    break;
+                case opcode::pow:
+                    for (std::size_t k = 0; k < n; ++k) {
+                        al[k] += a[k] * d[k] * std::pow(l[k], d[k] - 1);
+                        ar[k] += a[k] * v[k] * std::log(l[k]);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+private:
+    static const tape& recorded_on(const var& head) {
+        if (!head.get_tape()) {
+            throw std::logic_error("autodiff: batch needs a recorded var");
+        }
+        return *head.get_tape();
+    }
+
+    tape::index index_of(const var& x) const {
+        tape::index p = x.get_tape() == tape_
+                            ? tape_->position(x.get_index())
+                            : head_ + 1;
+        if (p > head_) {
+            throw std::logic_error("autodiff: var is not part of the batch");
+        }
+        return p;
+    }
+
+    double* column(std::vector<double>& b, tape::index i) const {
+        return b.data() + static_cast<std::size_t>(i) * width_;
+    }
+    const double* column(const std::vector<double>& b, tape::index i) const {
+        return b.data() + static_cast<std::size_t>(i) * width_;
+    }
+
+    const tape* tape_;
+    tape::index head_;
+    std::size_t width_;
+    std::vector<double> values_;
+    std::vector<double> adjoints_;
+};
+
+// Values and gradients of one recorded function at many points.
+struct batch_gradient {
+    std::size_t inputs;
+    std::vector<double> values;
+    std::vector<double> gradients;
+
+    double value(std::size_t point) const { return values[point]; }
+    // d y / d inputs[i] at the given point
+    double operator()(std::size_t point, std::size_t i) const {
+        return gradients[point * inputs + i];
+    }
+};
+
+// Differentiates y with respect to inputs at every point of `points`,
+// which holds one row of inputs.size() values per point. The points are
+// cut into chunks of `chunk` that the pool's workers share out, each
+// worker evaluating its chunks in a batch of its own, so nothing mutable
+// is shared between them; the tape is only read.
+inline batch_gradient gradient_batch(const var& y,
+                                     const std::vector<var>& inputs,
+                                     const std::vector<double>& points,
+                                     thread_pool& pool,
+                                     std::size_t chunk = 256) {
+    const std::size_t n = inputs.size();
+    if (n == 0 || points.size() % n != 0) {
+        throw std::invalid_argument(
+            "autodiff: points must hold one row per input point");
+    }
+    const std::size_t count = points.size() / n;
+    batch_gradient result{n, std::vector<double>(count),
+                          std::vector<double>(count * n)};
+    std::vector<std::unique_ptr<batch>> scratch(pool.size());
+    // built up front so that a foreign var throws here, not in a worker
+    scratch[0] = std::make_unique<batch>(y, chunk);
+    for (const auto& x : inputs) scratch[0]->values(x);
+
+    pool.parallel_for((count + chunk - 1) / chunk, [&](std::size_t task,
+                                                       std::size_t worker) {
+        auto& b = scratch[worker];
+        if (!b) b = std::make_unique<batch>(y, chunk);
+        const std::size_t first = task * chunk;
+        const std::size_t m = std::min(chunk, count - first);
+        for (std::size_t i = 0; i < n; ++i) {
+            double* c = b->values(inputs[i]);
+            for (std::size_t k = 0; k < m; ++k) {
+                c[k] = points[(first + k) * n + i];
+            }
+        }
+        b->forward();
+        b->backward();
+        const double* v = b->values(y);
+        std::copy(v, v + m, result.values.begin() + first);
+        for (std::size_t i = 0; i < n; ++i) {
+            const double* a = b->adjoints(inputs[i]);
+            for (std::size_t k = 0; k < m; ++k) {
+                result.gradients[(first + k) * n + i] = a[k];
+            }
+        }
+    });
+    return result;
+}
+
+inline batch_gradient gradient_batch(const var& y,
+                                     const std::vector<var>& inputs,
+                                     const std::vector<double>& points,
+                                     std::size_t threads) {
+    thread_pool pool(threads);
+    return gradient_batch(y, inputs, points, pool);
+}
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,52 @@
+#include "arena.hpp"
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// Rebuilds the same small loss from fresh parameters every iteration,
+// as an optimisation loop does, and reads its gradient.
+double iteration(const std::vector<double>& p) {
+    auto exp_ = functions::exp();
+    std::vector<var> x;
+    x.reserve(p.size());
+    for (double v : p) x.emplace_back(v);
+    var loss(0.0);
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        loss = loss + exp_(x[i] * x[i + 1] - 1.0) * 0.5;
+    }
+    auto G = gradient(loss);
+    return G[x[0]];
+}
+
+void heap(std::size_t n, int iterations) {
+    std::vector<double> x;
+    for (std::size_t i = 0; i < n; ++i) x.push_back(0.01 * i);
+    auto r = benchmark::measure([&x] { benchmark::keep(iteration(x)); },
+                                iterations);
+    benchmark::report("heap build+gradient", n, r);
+}
+
+void pooled(std::size_t n, int iterations) {
+    std::vector<double> x;
+    for (std::size_t i = 0; i < n; ++i) x.push_back(0.01 * i);
+    arena a;
+    auto r = benchmark::measure([&x, &a] {
+        {
+            arena::scope s(a);
+            benchmark::keep(iteration(x));
+        }
+        a.reset();
+    }, iterations);
+    benchmark::report("arena build+gradient", n, r);
+}
+
+int main() {
+    for (std::size_t n : {16, 64}) {
+        heap(n, 1000);
+        pooled(n, 1000);
+    }
+}
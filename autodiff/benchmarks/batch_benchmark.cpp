@@ -0,0 +1,122 @@
+#include "batch.hpp"
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+template <typename T>
+T model(std::vector<T>& x) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    T s = x[0];
+    for (int k = 0; k < 8; ++k) {
+        for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+            s = s * x[i] + x[i + 1] / (s * s + 1.0) + sin_(x[i]) * 0.5;
+        }
+        s = s / (exp_(-s) + 1.0);
+    }
+    return s;
+}
+
+std::vector<var> inputs() {
+    return {var(0.1), var(0.2), var(0.3), var(0.4)};
+}
+
+double sample(std::size_t p, std::size_t i) { return 0.001 * p + 0.1 * i; }
+
+void tree(std::size_t points) {
+    auto x = inputs();
+    auto y = model(x);
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (std::size_t p = 0; p < points; ++p) {
+            for (std::size_t i = 0; i < x.size(); ++i) {
+                set_value(x[i], sample(p, i));
+            }
+            y.forward_pass();
+            auto G = gradient(y);
+            s += G[x[0]];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report("tree, point by point", points, r);
+}
+
+void pointwise(std::size_t points) {
+    tape t;
+    tape::recording rec(t);
+    auto x = inputs();
+    auto y = model(x);
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (std::size_t p = 0; p < points; ++p) {
+            for (std::size_t i = 0; i < x.size(); ++i) {
+                set_value(x[i], sample(p, i));
+            }
+            y.forward_pass();
+            auto G = gradient(y);
+            s += G[x[0]];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report("tape, point by point", points, r);
+}
+
+void batched(std::size_t points, std::size_t width) {
+    tape t;
+    tape::recording rec(t);
+    auto x = inputs();
+    auto y = model(x);
+    auto r = benchmark::measure([&] {
+        batch b(y, width);
+        double s = 0;
+        for (std::size_t p0 = 0; p0 < points; p0 += width) {
+            std::size_t n = std::min(width, points - p0);
+            for (std::size_t i = 0; i < x.size(); ++i) {
+                double* c = b.values(x[i]);
+                for (std::size_t k = 0; k < n; ++k) c[k] = sample(p0 + k, i);
+            }
+            b.forward();
+            b.backward();
+            for (std::size_t k = 0; k < n; ++k) s += b.adjoints(x[0])[k];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report("batch, width " + std::to_string(width), points, r);
+}
+
+void parallel(std::size_t points, std::size_t threads) {
+    tape t;
+    tape::recording rec(t);
+    auto x = inputs();
+    auto y = model(x);
+    std::vector<double> rows;
+    rows.reserve(points * x.size());
+    for (std::size_t p = 0; p < points; ++p) {
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            rows.push_back(sample(p, i));
+        }
+    }
+    thread_pool pool(threads);
+    auto r = benchmark::measure([&] {
+        auto G = gradient_batch(y, x, rows, pool);
+        benchmark::keep(G(0, 0));
+    });
+    benchmark::report("gradient_batch, " + std::to_string(threads) +
+                          " threads",
+                      points, r);
+}
+
+int main() {
+    for (std::size_t points : {10000, 100000}) {
+        tree(points);
+        pointwise(points);
+        batched(points, 64);
+        batched(points, 256);
+        for (std::size_t threads : {1, 2, 4, 8}) parallel(points, threads);
+    }
+}
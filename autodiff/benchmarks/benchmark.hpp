@@ -0,0 +1,63 @@
+#pragma once
+
+// Minimal timing and allocation counting shared by the benchmarks. Each
+// benchmark is a single translation unit, which is what allows this
+// header to replace the global allocation functions.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace benchmark {
+
+// Counted from every thread that allocates, e.g. the pool's workers.
+inline std::atomic<std::size_t>& allocations() {
+    static std::atomic<std::size_t> n{0};
+    return n;
+}
+
+struct result {
+    double seconds;
+    std::size_t allocations;
+};
+
+// Runs f `repeats` times and reports the mean wall time and the mean
+// number of heap allocations per run.
+template <typename F>
+result measure(F&& f, int repeats = 1) {
+    std::size_t a = allocations().load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) f();
+    auto stop = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = stop - start;
+    std::size_t b = allocations().load(std::memory_order_relaxed);
+    return {elapsed.count() / repeats, (b - a) / repeats};
+}
+
+inline void report(const std::string& name, std::size_t n, const result& r) {
+    std::printf("%-28s n=%-9zu %12.3f us %12zu allocs\n", name.c_str(), n,
+                r.seconds * 1e6, r.allocations);
+}
+
+// Keeps the optimiser from discarding a computed value: the empty asm
+// claims to read it.
+inline void keep(double v) { asm volatile("" : : "g"(v) : "memory"); }
+
+}  // namespace benchmark
+
+// Out of line, so that the compiler does not see through them to malloc()
+// and free() and take the pairs for mismatched ones.
+[[gnu::noinline]] void* operator new(std::size_t n) {
+    benchmark::allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
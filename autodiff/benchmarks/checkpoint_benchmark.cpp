@@ -0,0 +1,64 @@
+#include "benchmark.hpp"
+#include "checkpoint.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// A chain of coupled oscillators stepped with explicit Euler.
+std::vector<var> oscillators(const std::vector<var>& s,
+                             const std::vector<var>& p, std::size_t) {
+    auto sin_ = functions::sin();
+    const std::size_t n = s.size() / 2;
+    std::vector<var> next;
+    next.reserve(s.size());
+    for (std::size_t i = 0; i < n; ++i) next.push_back(s[i] + s[n + i] * 0.01);
+    for (std::size_t i = 0; i < n; ++i) {
+        var x = s[i];
+        var f = sin_(x) * p[0] * -1.0;
+        if (i > 0) f = f + (s[i - 1] - s[i]) * p[1];
+        if (i + 1 < n) f = f + (s[i + 1] - s[i]) * p[1];
+        next.push_back(s[n + i] + f * 0.01);
+    }
+    return next;
+}
+
+var energy(const std::vector<var>& s) {
+    var e = s[0] * s[0];
+    for (std::size_t i = 1; i < s.size(); ++i) e = e + s[i] * s[i];
+    return e;
+}
+
+void report(const char* name, std::size_t steps, checkpoint& c,
+            const std::vector<double>& x0, const std::vector<double>& p) {
+    auto r = benchmark::measure(
+        [&] { benchmark::keep(c.gradient(x0, p).value); });
+    benchmark::report(name, steps, r);
+    std::printf("%-28s %zu evaluations, %zu snapshots, %zu KB peak\n", "",
+                c.last().evaluations, c.last().peak_snapshots,
+                c.last().peak_bytes / 1024);
+}
+
+int main() {
+    const std::size_t steps = 20000;
+    std::vector<double> x0(32);
+    for (std::size_t i = 0; i < 16; ++i) x0[i] = std::sin(0.3 * i);
+    std::vector<double> p{9.81, 4.0};
+
+    checkpoint c(oscillators, energy, steps, 0);
+    c.segments({});
+    report("one tape", steps, c, x0, p);
+    std::vector<std::size_t> marks;
+    for (std::size_t m = 141; m < steps; m += 141) marks.push_back(m);
+    c.segments(marks);
+    report("segments of sqrt(n)", steps, c, x0, p);
+    for (std::size_t s : {1000, 100, 20, 5}) {
+        c.keep(s);
+        char name[32];
+        std::snprintf(name, sizeof name, "binomial, %zu snapshots", s);
+        report(name, steps, c, x0, p);
+    }
+}
@@ -0,0 +1,72 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// Written the way generated code tends to be: every term rebuilds the
+// same shared factor and the same pairwise products from scratch.
+var model(std::vector<var>& x) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    var y = x[0] * 0.0;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        for (std::size_t j = 0; j < 4; ++j) {
+            auto scale = exp_(x[0] * 0.5) * sin_(x[0] + 1.0);
+            auto pair = x[i] * x[(i + 1) % x.size()];
+            y = y + scale * pair + pair * 2.0;
+        }
+    }
+    return y;
+}
+
+void tree(std::size_t n, bool shared) {
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    std::size_t nodes = 0;
+    auto r = benchmark::measure([&] {
+        cse table;
+        std::unique_ptr<cse::scope> s;
+        if (shared) s = std::make_unique<cse::scope>(table);
+        var y = model(x);
+        auto G = gradient(y);
+        benchmark::keep(G[x[0]]);
+        nodes = y.topological_order().size();
+    });
+    benchmark::report(shared ? "tree build+gradient, cse"
+                             : "tree build+gradient",
+                      n, r);
+    std::printf("%-28s %zu nodes\n", "", nodes);
+}
+
+void taped(std::size_t n, bool shared) {
+    std::size_t records = 0;
+    auto r = benchmark::measure([&] {
+        tape t;
+        t.share(shared);
+        tape::recording rec(t);
+        std::vector<var> x;
+        for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+        var y = model(x);
+        auto G = gradient(y);
+        benchmark::keep(G[x[0]]);
+        records = t.size();
+    });
+    benchmark::report(shared ? "tape record+gradient, cse"
+                             : "tape record+gradient",
+                      n, r);
+    std::printf("%-28s %zu records\n", "", records);
+}
+
+int main() {
+    for (std::size_t n : {1000, 10000}) {
+        tree(n, false);
+        tree(n, true);
+        taped(n, false);
+        taped(n, true);
+    }
+}
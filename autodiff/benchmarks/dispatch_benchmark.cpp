@@ -0,0 +1,60 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+using namespace autodiff;
+using namespace base;
+
+// A deep chain mixing every operation, so the forward and backward
+// passes spend their time selecting the operation rather than on any
+// single piece of arithmetic.
+var chain(var& x, var& a, var& b, int steps) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto ln_ = functions::ln();
+    var y = x;
+    for (int i = 0; i < steps; ++i) {
+        y = ln_(exp_(cos_(sin_(y) * a + b) / b - a));
+    }
+    return y;
+}
+
+void tree(int steps) {
+    var x(0.5);
+    var a(0.75);
+    var b(2.0);
+    auto y = chain(x, a, b, steps);
+    auto f = benchmark::measure([&y] { benchmark::keep(y.forward_pass()); },
+                                100);
+    benchmark::report("tree forward_pass", steps, f);
+    auto g = benchmark::measure([&y] {
+        y.clean_grad();
+        y.set_gradient(1.0);
+        y.grad();
+    }, 100);
+    benchmark::report("tree grad", steps, g);
+}
+
+void recorded(int steps) {
+    tape t;
+    tape::recording r(t);
+    var x(0.5);
+    var a(0.75);
+    var b(2.0);
+    auto y = chain(x, a, b, steps);
+    auto f = benchmark::measure([&y] { benchmark::keep(y.forward_pass()); },
+                                100);
+    benchmark::report("tape forward_pass", steps, f);
+    auto g = benchmark::measure([&y, &x] {
+        auto G = gradient(y);
+        benchmark::keep(G[x]);
+    }, 100);
+    benchmark::report("tape gradient", steps, g);
+}
+
+int main() {
+    for (int steps : {100, 1000}) {
+        tree(steps);
+        recorded(steps);
+    }
+}
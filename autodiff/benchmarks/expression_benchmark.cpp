@@ -0,0 +1,107 @@
+#include "benchmark.hpp"
+#include "dual.hpp"
+#include "expression.hpp"
+#include "gradient.hpp"
+
+#include <array>
+#include <cstdio>
+
+using namespace autodiff;
+namespace ex = autodiff::expression;
+
+// The two pricing formulas (c + d) * d and exp(a * b) + a, differentiated
+// many times at slightly different points.
+const int calls = 1000000;
+
+// One call evaluates both formulas with their gradients; nanoseconds are
+// a better unit here than benchmark::report's microseconds.
+void report(const char* name, const benchmark::result& r, int n) {
+    std::printf("%-28s %10.1f ns/call %10.2f allocs/call\n", name,
+                r.seconds / n * 1e9, double(r.allocations) / n);
+}
+
+void templates() {
+    ex::arg<0> a;
+    ex::arg<1> b;
+    auto f = (a + b) * b;
+    auto g = ex::exp(a * b) + a;
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (int i = 0; i < calls; ++i) {
+            double x = 1e-6 * i;
+            auto F = ex::evaluate(f, {x, 2.0});
+            auto G = ex::evaluate(g, {x, 0.5});
+            s += F.gradient[0] + F.gradient[1] + G.gradient[0] + G.gradient[1];
+        }
+        benchmark::keep(s);
+    });
+    report("expression templates", r, calls);
+}
+
+void tree() {
+    auto exp_ = functions::exp();
+    const int n = calls / 100;
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (int i = 0; i < n; ++i) {
+            base::var a(1e-6 * i);
+            base::var b(2.0);
+            auto F = base::gradient((a + b) * b);
+            base::var c(1e-6 * i);
+            base::var d(0.5);
+            auto G = base::gradient(exp_(c * d) + c);
+            s += F[a] + F[b] + G[c] + G[d];
+        }
+        benchmark::keep(s);
+    });
+    report("tree", r, n);
+}
+
+void recorded() {
+    auto exp_ = functions::exp();
+    base::tape t;
+    const int n = calls / 10;
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (int i = 0; i < n; ++i) {
+            t.clear();
+            base::tape::recording rec(t);
+            base::var a(1e-6 * i);
+            base::var b(2.0);
+            auto F = base::gradient((a + b) * b);
+            s += F[a] + F[b];
+            base::var c(1e-6 * i);
+            base::var d(0.5);
+            auto G = base::gradient(exp_(c * d) + c);
+            s += G[c] + G[d];
+        }
+        benchmark::keep(s);
+    });
+    report("tape", r, n);
+}
+
+void dual() {
+    using forward::dual_n;
+    auto r = benchmark::measure([&] {
+        double s = 0;
+        for (int i = 0; i < calls; ++i) {
+            auto a = forward::seed<2>(1e-6 * i, 0);
+            auto b = forward::seed<2>(2.0, 1);
+            auto F = (a + b) * b;
+            auto c = forward::seed<2>(1e-6 * i, 0);
+            auto d = forward::seed<2>(0.5, 1);
+            auto G = forward::exp(c * d) + c;
+            s += F.tangent()[0] + F.tangent()[1] + G.tangent()[0] +
+                 G.tangent()[1];
+        }
+        benchmark::keep(s);
+    });
+    report("dual_n<2>", r, calls);
+}
+
+int main() {
+    templates();
+    dual();
+    recorded();
+    tree();
+}
@@ -0,0 +1,130 @@
+#include "benchmark.hpp"
+#include "dual.hpp"
+#include "gradient.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+
+// f : R^2 -> R^m, f_i(x, y) = sin(x * c_i) * y + exp(y / (c_i + x)). The
+// full Jacobian takes two forward passes, one per input, but m reverse
+// sweeps.
+template <typename T>
+std::vector<T> model(const T& x, const T& y, std::size_t m) {
+    auto sin_ = functions::sin();
+    auto exp_ = functions::exp();
+    std::vector<T> out;
+    out.reserve(m);
+    for (std::size_t i = 0; i < m; ++i) {
+        T c(1.0 + 0.01 * i);
+        out.push_back(sin_(x * c) * y + exp_(y / (c + x)));
+    }
+    return out;
+}
+
+void forward_mode(std::size_t m) {
+    using forward::dual;
+    auto r = benchmark::measure([m] {
+        double s = 0;
+        for (int k = 0; k < 2; ++k) {
+            dual<double> x(0.3, k == 0), y(0.7, k == 1);
+            for (const auto& f : model(x, y, m)) s += f.tangent();
+        }
+        benchmark::keep(s);
+    }, 20);
+    benchmark::report("dual jacobian", m, r);
+}
+
+void tree(std::size_t m) {
+    using base::var;
+    auto r = benchmark::measure([m] {
+        var x(0.3), y(0.7);
+        double s = 0;
+        for (auto& f : model(x, y, m)) {
+            auto G = base::gradient(f);
+            s += G[x] + G[y];
+        }
+        benchmark::keep(s);
+    }, 20);
+    benchmark::report("tree jacobian", m, r);
+}
+
+void recorded(std::size_t m) {
+    using base::var;
+    base::tape t;
+    auto r = benchmark::measure([&t, m] {
+        t.clear();
+        base::tape::recording rec(t);
+        var x(0.3), y(0.7);
+        double s = 0;
+        for (auto& f : model(x, y, m)) {
+            auto G = base::gradient(f);
+            s += G[x] + G[y];
+        }
+        benchmark::keep(s);
+    }, 20);
+    benchmark::report("tape jacobian", m, r);
+}
+
+// A function of n inputs: its gradient takes n scalar passes, each
+// repeating the same primal work, or a single pass with n lanes.
+template <typename T>
+T chain(const std::vector<T>& x) {
+    auto sin_ = functions::sin();
+    auto exp_ = functions::exp();
+    T s(0);
+    for (int k = 0; k < 16; ++k) {
+        for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+            s = s + sin_(x[i] * x[i + 1]) * exp_(x[i + 1] / (1.0 + s * s));
+        }
+    }
+    return s;
+}
+
+template <std::size_t N>
+void scalar_passes() {
+    using forward::dual;
+    auto r = benchmark::measure([] {
+        std::vector<dual<double>> x(N);
+        double s = 0;
+        for (std::size_t d = 0; d < N; ++d) {
+            for (std::size_t i = 0; i < N; ++i) {
+                x[i] = dual<double>(0.1 * i, i == d);
+            }
+            s += chain(x).tangent();
+        }
+        benchmark::keep(s);
+    }, 200);
+    benchmark::report("dual gradient, N passes", N, r);
+}
+
+template <std::size_t N>
+void lane_pass() {
+    auto r = benchmark::measure([] {
+        std::vector<forward::dual_n<double, N>> x;
+        for (std::size_t i = 0; i < N; ++i) {
+            x.push_back(forward::seed<N>(0.1 * i, i));
+        }
+        auto y = chain(x);
+        double s = 0;
+        for (std::size_t d = 0; d < N; ++d) s += y.tangent()[d];
+        benchmark::keep(s);
+    }, 200);
+    benchmark::report("dual_n gradient, one pass", N, r);
+}
+
+int main() {
+    scalar_passes<4>();
+    lane_pass<4>();
+    scalar_passes<8>();
+    lane_pass<8>();
+    scalar_passes<16>();
+    lane_pass<16>();
+
+    for (std::size_t m : {1, 10, 100, 1000}) {
+        forward_mode(m);
+        tree(m);
+        recorded(m);
+    }
+}
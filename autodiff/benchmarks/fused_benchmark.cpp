@@ -0,0 +1,42 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// Builds sum = sum + x[i] * x[i] and p = p * x[i] over n tree vars and
+// takes their gradients.
+void run(std::size_t n) {
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(1 + 1e-6 * i);
+    auto sum = benchmark::measure([&] {
+        var s = x[0];
+        for (std::size_t i = 1; i < n; ++i) s = s + x[i] * x[i];
+        auto G = gradient(s);
+        benchmark::keep(G[x[0]]);
+    }, 5);
+    benchmark::report("sum chain + gradient", n, sum);
+    auto product = benchmark::measure([&] {
+        var p = x[0];
+        for (std::size_t i = 1; i < n; ++i) p = p * x[i];
+        auto G = gradient(p);
+        benchmark::keep(G[x[0]]);
+    }, 5);
+    benchmark::report("product chain + gradient", n, product);
+
+    var s = x[0];
+    for (std::size_t i = 1; i < n; ++i) s = s + x[i];
+    auto passes = benchmark::measure([&] {
+        benchmark::keep(s.forward_pass());
+        s.clean_grad();
+        s.set_gradient(1.0);
+        s.grad();
+    }, 5);
+    benchmark::report("sum forward + backward", n, passes);
+}
+
+int main() {
+    for (std::size_t n : {1000, 100000}) run(n);
+}
@@ -0,0 +1,91 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "hessian.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// A smooth coupled objective of the kind a Newton step is taken on.
+var model(std::vector<var>& x) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    var y = x[0] * 0.0;
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        y = y + exp_(x[i] * x[i + 1] * 0.1) + sin_(x[i]) * x[i + 1] * x[i];
+    }
+    return y;
+}
+
+// d f / d x at x + s v, recomputed on the tape.
+void gradient_at(var& f, std::vector<var>& x, const std::vector<double>& x0,
+                 const std::vector<double>& v, double s, double* g) {
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        set_value(x[i], x0[i] + s * v[i]);
+    }
+    f.forward_pass();
+    auto G = gradient(f);
+    for (std::size_t i = 0; i < x.size(); ++i) g[i] = G[x[i]];
+}
+
+void run(std::size_t n) {
+    tape t;
+    tape::recording rec(t);
+    std::vector<var> x;
+    std::vector<double> x0;
+    for (std::size_t i = 0; i < n; ++i) {
+        x0.push_back(0.01 * i);
+        x.emplace_back(x0.back());
+    }
+    var f = model(x);
+    std::vector<double> v(n);
+    for (std::size_t i = 0; i < n; ++i) v[i] = std::sin(double(i));
+    std::vector<double> g(n), lo(n), hi(n), hv(n), fd(n);
+    const double h = 1e-5;
+
+    auto grad = benchmark::measure(
+        [&] { gradient_at(f, x, x0, v, 0, g.data()); }, 100);
+    benchmark::report("gradient", n, grad);
+
+    hessian H(f, x);
+    auto ad =
+        benchmark::measure([&] { H.product(v.data(), hv.data()); }, 100);
+    benchmark::report("hvp, forward-over-reverse", n, ad);
+    auto diff = benchmark::measure([&] {
+        gradient_at(f, x, x0, v, h, hi.data());
+        gradient_at(f, x, x0, v, -h, lo.data());
+        for (std::size_t i = 0; i < n; ++i) fd[i] = (hi[i] - lo[i]) / (2 * h);
+    }, 100);
+    benchmark::report("hvp, central differences", n, diff);
+    double error = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        error = std::max(error, std::abs(fd[i] - hv[i]));
+    }
+    std::printf("%-28s %g\n", "  largest difference", error);
+
+    auto full = benchmark::measure([&] { benchmark::keep(H.matrix()[0]); });
+    benchmark::report("hessian, forward-over-reverse", n, full);
+    auto full_fd = benchmark::measure([&] {
+        std::vector<double> e(n, 0.0);
+        std::vector<double> m(n * n);
+        for (std::size_t j = 0; j < n; ++j) {
+            e[j] = 1;
+            gradient_at(f, x, x0, e, h, hi.data());
+            gradient_at(f, x, x0, e, -h, lo.data());
+            for (std::size_t i = 0; i < n; ++i) {
+                m[j * n + i] = (hi[i] - lo[i]) / (2 * h);
+            }
+            e[j] = 0;
+        }
+        benchmark::keep(m[0]);
+    });
+    benchmark::report("hessian, central differences", n, full_fd);
+}
+
+int main() {
+    for (std::size_t n : {10, 1000}) run(n);
+}
@@ -0,0 +1,91 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "incremental.hpp"
+
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// sum_i x_i * x_{i+1} + sin(x_i), reduced pairwise
+var model(std::vector<var>& x) {
+    auto sin_ = functions::sin();
+    std::vector<var> terms;
+    terms.reserve(x.size());
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        terms.push_back(x[i] * x[i + 1] + sin_(x[i]));
+    }
+    while (terms.size() > 1) {
+        std::vector<var> next;
+        next.reserve(terms.size() / 2 + 1);
+        for (std::size_t i = 0; i + 1 < terms.size(); i += 2) {
+            next.push_back(terms[i] + terms[i + 1]);
+        }
+        if (terms.size() % 2) next.push_back(terms.back());
+        terms.swap(next);
+    }
+    return terms.front();
+}
+
+std::vector<var> inputs(std::size_t n) {
+    std::vector<var> x;
+    x.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    return x;
+}
+
+// Every step changes one of the n inputs, then asks for the value and
+// the gradient with respect to it.
+void tree(std::size_t n) {
+    auto x = inputs(n);
+    auto y = model(x);
+    std::size_t step = 0;
+    auto r = benchmark::measure([&] {
+        std::size_t i = (step++ * 7919) % n;
+        set_value(x[i], 0.5);
+        y.forward_pass();
+        auto G = gradient(y);
+        benchmark::keep(G[x[i]]);
+    }, 20);
+    benchmark::report("tree, full", n, r);
+}
+
+void full(std::size_t n) {
+    tape t;
+    tape::recording rec(t);
+    auto x = inputs(n);
+    auto y = model(x);
+    std::size_t step = 0;
+    auto r = benchmark::measure([&] {
+        std::size_t i = (step++ * 7919) % n;
+        set_value(x[i], 0.5);
+        y.forward_pass();
+        auto G = gradient(y);
+        benchmark::keep(G[x[i]]);
+    }, 20);
+    benchmark::report("tape, full", n, r);
+}
+
+void dirty(std::size_t n) {
+    tape t;
+    tape::recording rec(t);
+    auto x = inputs(n);
+    auto y = model(x);
+    incremental inc(y);
+    std::size_t step = 0;
+    auto r = benchmark::measure([&] {
+        std::size_t i = (step++ * 7919) % n;
+        inc.set_value(x[i], 0.5 + 0.001 * step);
+        inc.forward();
+        benchmark::keep(inc[x[i]]);
+    }, 1000);
+    benchmark::report("incremental", n, r);
+}
+
+int main() {
+    for (std::size_t n : {100, 1000, 10000, 100000}) {
+        tree(n);
+        full(n);
+        dirty(n);
+    }
+}
@@ -0,0 +1,60 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "jacobian.hpp"
+
+#include <cstdio>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// Many outputs over one shared core, the shape of a model with a few
+// hundred reported quantities.
+std::vector<var> model(std::vector<var>& x, std::size_t outputs) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    var core = x[0] * 0.0;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        core = core + exp_(x[i] * 0.01) * sin_(x[(i + 1) % x.size()]);
+    }
+    std::vector<var> y;
+    for (std::size_t k = 0; k < outputs; ++k) {
+        y.push_back(core * x[k % x.size()] + x[(k * 7) % x.size()] * 2.0);
+    }
+    return y;
+}
+
+void run(std::size_t inputs, std::size_t outputs, bool recorded) {
+    tape t;
+    std::unique_ptr<tape::recording> r;
+    if (recorded) r = std::make_unique<tape::recording>(t);
+    std::vector<var> x;
+    for (std::size_t i = 0; i < inputs; ++i) x.emplace_back(0.01 * i);
+    auto y = model(x, outputs);
+    const char* each = recorded ? "tape gradient per output"
+                                : "tree gradient per output";
+    auto g = benchmark::measure([&] {
+        double s = 0;
+        for (auto& v : y) {
+            auto G = gradient(v);
+            for (auto& xi : x) s += G[xi];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report(each, outputs, g);
+    auto j = benchmark::measure([&] {
+        jacobian J(y, x);
+        benchmark::keep(J(0, 0));
+    });
+    benchmark::report(recorded ? "tape jacobian" : "tree jacobian", outputs,
+                      j);
+}
+
+int main() {
+    for (bool recorded : {false, true}) {
+        std::printf("%zu inputs\n", std::size_t(20));
+        run(20, 300, recorded);
+        std::printf("%zu inputs\n", std::size_t(300));
+        run(300, 300, recorded);
+    }
+}
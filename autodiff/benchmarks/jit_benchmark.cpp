@@ -0,0 +1,93 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "jit.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// A hot expression re-evaluated at many points: a sum of smooth terms
+// over a few hundred inputs.
+var model(std::vector<var>& x) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    var y = x[0] * 0.0;
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        y = y + exp_(x[i] * 0.01) * sin_(x[i + 1]) + x[i] * x[i + 1] * 0.5;
+    }
+    return y;
+}
+
+const int points = 2000;
+
+void run(std::size_t n) {
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    var y = model(x);
+
+    auto tree = benchmark::measure([&] {
+        double s = 0;
+        for (int p = 0; p < points; ++p) {
+            set_value(x[0], 1e-3 * p);
+            s += y.forward_pass();
+            auto G = gradient(y);
+            s += G[x[0]];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report("tree forward+gradient", n, tree);
+
+    {
+        tape t;
+        tape::recording r(t);
+        std::vector<var> z;
+        for (std::size_t i = 0; i < n; ++i) z.emplace_back(0.001 * i);
+        var w = model(z);
+        auto recorded = benchmark::measure([&] {
+            double s = 0;
+            for (int p = 0; p < points; ++p) {
+                set_value(z[0], 1e-3 * p);
+                s += w.forward_pass();
+                auto G = gradient(w);
+                s += G[z[0]];
+            }
+            benchmark::keep(s);
+        });
+        benchmark::report("tape forward+gradient", n, recorded);
+    }
+
+    // a directory of its own so that the first compilation is not
+    // served from an earlier run
+    auto dir =
+        std::filesystem::temp_directory_path() / "autodiff-jit-benchmark";
+    std::filesystem::remove_all(dir);
+    codegen::jit j(dir);
+    auto start = std::chrono::steady_clock::now();
+    codegen::kernel k = j.compile(y, x);
+    std::chrono::duration<double> first =
+        std::chrono::steady_clock::now() - start;
+    benchmark::report("jit compile", n, {first.count(), 0});
+    auto compile = benchmark::measure([&] { k = j.compile(y, x); });
+    benchmark::report("jit compile (cached)", n, compile);
+    std::vector<double> in(n);
+    std::vector<double> g(n);
+    for (std::size_t i = 0; i < n; ++i) in[i] = 0.001 * i;
+    auto compiled = benchmark::measure([&] {
+        double s = 0;
+        for (int p = 0; p < points; ++p) {
+            in[0] = 1e-3 * p;
+            s += k(in.data(), g.data());
+            s += g[0];
+        }
+        benchmark::keep(s);
+    });
+    benchmark::report("jit kernel", n, compiled);
+}
+
+int main() {
+    for (std::size_t n : {10, 300}) run(n);
+}
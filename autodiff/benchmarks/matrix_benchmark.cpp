@@ -0,0 +1,98 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "tensor.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace autodiff;
+
+std::vector<double> filled(std::size_t n, double phase) {
+    std::vector<double> v(n);
+    for (std::size_t i = 0; i < n; ++i) v[i] = std::sin(i * 0.7 + phase);
+    return v;
+}
+
+// The loss of a linear model, |X w - y|^2, and its gradient in w, with
+// scalar vars on a tape and with one matvec node.
+void regression(std::size_t n) {
+    auto xs = filled(n * n, 0.1);
+    auto ws = filled(n, 0.2);
+    auto ys = filled(n, 0.3);
+    auto recorded = benchmark::measure([&] {
+        base::tape t;
+        base::tape::recording r(t);
+        std::vector<base::var> w;
+        for (double v : ws) w.emplace_back(v);
+        base::var loss = w[0] * 0.0;
+        for (std::size_t i = 0; i < n; ++i) {
+            base::var e = w[0] * xs[i * n] - ys[i];
+            for (std::size_t j = 1; j < n; ++j) e = e + w[j] * xs[i * n + j];
+            loss = loss + e * e;
+        }
+        base::gradient G(loss);
+        benchmark::keep(G[w[0]]);
+    });
+    benchmark::report("regression, tape vars", n, recorded);
+    auto arrays = benchmark::measure([&] {
+        tensor::array X = tensor::array::constant(n, n, xs);
+        tensor::array w(ws);
+        tensor::array y = tensor::array::constant(ys);
+        tensor::array e = matvec(X, w) - y;
+        tensor::gradient G(dot(e, e));
+        benchmark::keep(G[w][0]);
+    }, 5);
+    benchmark::report("regression, matvec", n, arrays);
+}
+
+// C = A B and both adjoints, against the textbook triple loop.
+void product(std::size_t n) {
+    auto av = filled(n * n, 0.1);
+    auto bv = filled(n * n, 0.2);
+    auto textbook = benchmark::measure([&] {
+        std::vector<double> c(n * n, 0.0);
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                double s = 0;
+                for (std::size_t p = 0; p < n; ++p) {
+                    s += av[i * n + p] * bv[p * n + j];
+                }
+                c[i * n + j] = s;
+            }
+        }
+        benchmark::keep(c[0]);
+    });
+    benchmark::report("matmul, textbook loop", n, textbook);
+    tensor::array a(n, n, av);
+    tensor::array b(n, n, bv);
+    auto forward = benchmark::measure([&] {
+        tensor::array c = matmul(a, b);
+        benchmark::keep(c[0]);
+    }, 3);
+    benchmark::report("matmul, blocked", n, forward);
+    std::printf("%-28s %.2f GFLOP/s\n", "", 2.0 * n * n * n /
+                                                 forward.seconds * 1e-9);
+    tensor::array c = sum(matmul(a, b));
+    auto both = benchmark::measure([&] {
+        tensor::gradient G(c);
+        benchmark::keep(G[a][0]);
+    }, 3);
+    benchmark::report("matmul adjoints", n, both);
+
+    std::size_t threads = std::thread::hardware_concurrency();
+    base::thread_pool pool(threads);
+    tensor::parallel scope(pool);
+    auto shared = benchmark::measure([&] {
+        tensor::array c = matmul(a, b);
+        benchmark::keep(c[0]);
+    }, 3);
+    std::printf("%zu threads\n", pool.size());
+    benchmark::report("matmul, blocked", n, shared);
+}
+
+int main() {
+    regression(300);
+    product(512);
+}
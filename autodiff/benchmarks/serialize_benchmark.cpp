@@ -0,0 +1,66 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "serialize.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// A long recorded chain over a few named inputs.
+var model(std::vector<var>& x, std::size_t n) {
+    auto sin_ = functions::sin();
+    var y = x[0] * 1.0;
+    for (std::size_t i = 1; y.get_tape()->size() < n; ++i) {
+        y = y * 0.999 + sin_(x[i % x.size()]);
+    }
+    return y;
+}
+
+std::vector<var> inputs() {
+    std::vector<var> x;
+    for (int i = 0; i < 8; ++i) {
+        x.emplace_back(std::string("x") + std::to_string(i), 0.1 * i);
+    }
+    return x;
+}
+
+void run(std::size_t n) {
+    const std::string path = "/tmp/autodiff-serialize-benchmark.adg";
+    {
+        tape t;
+        tape::recording r(t);
+        auto x = inputs();
+        var y(0.0);
+        auto build = benchmark::measure([&] { y = model(x, n); });
+        benchmark::report("record", t.size(), build);
+        auto s = benchmark::measure([&] { save(path, {y}, x); });
+        benchmark::report("save", t.size(), s);
+    }
+
+    std::unique_ptr<image> m;
+    auto load = benchmark::measure([&] { m = std::make_unique<image>(path); });
+    benchmark::report("load", n, load);
+    auto verified = benchmark::measure(
+        [&] { benchmark::keep(image(path, true).outputs()); });
+    benchmark::report("load, verified", n, verified);
+
+    var y = m->output(0);
+    var x = m->leaf("x0");
+    for (int pass = 0; pass < 2; ++pass) {
+        auto f = benchmark::measure([&] {
+            benchmark::keep(y.forward_pass());
+            benchmark::keep(gradient(y)[x]);
+        });
+        benchmark::report(pass == 0 ? "first forward+gradient"
+                                    : "next forward+gradient",
+                          n, f);
+    }
+    std::remove(path.c_str());
+}
+
+int main() {
+    for (std::size_t n : {1000000, 10000000}) run(n);
+}
@@ -0,0 +1,52 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <cstdio>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// The shape of generated models: unit scales, zero shifts, unit
+// conversions applied one after another and constants derived from
+// other constants.
+var model(std::vector<var>& x, var& k) {
+    auto exp_ = functions::exp();
+    var y = x[0] * 0.0;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        auto scaled = (x[i] * 1000.0) * 0.001 * 1.0 + 0.0;
+        auto offset = (scaled + 273.15) - 273.15;
+        y = y + exp_(k * 0.5 - 1.0) * offset * offset;
+    }
+    return y;
+}
+
+void run(std::size_t n, bool simplified) {
+    tape t;
+    tape::recording rec(t);
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    var k(token(2.0, true), 2.0);
+    auto y = model(x, k);
+    std::size_t before = t.size();
+    if (simplified) {
+        auto s = benchmark::measure([&] { t.simplify(y.get_index()); });
+        benchmark::report("simplify", n, s);
+        std::printf("%-28s %zu -> %zu records\n", "", before, t.size());
+    }
+    auto r = benchmark::measure([&] {
+        benchmark::keep(y.forward_pass());
+        auto G = gradient(y);
+        benchmark::keep(G[x[0]]);
+    }, 20);
+    benchmark::report(simplified ? "simplified forward+gradient"
+                                 : "recorded forward+gradient",
+                      n, r);
+}
+
+int main() {
+    for (std::size_t n : {1000, 100000}) {
+        run(n, false);
+        run(n, true);
+    }
+}
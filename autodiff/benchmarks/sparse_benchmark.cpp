@@ -0,0 +1,67 @@
+#include "benchmark.hpp"
+#include "sparse.hpp"
+
+#include <cstdio>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// A discretised one-dimensional problem: every residual couples a point
+// to its two neighbours, and the energy is the sum of their squares.
+std::vector<var> residuals(std::vector<var>& x) {
+    auto exp_ = functions::exp();
+    std::vector<var> r;
+    const std::size_t n = x.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        var left = i > 0 ? x[i - 1] : x[i] * 0.0;
+        var right = i + 1 < n ? x[i + 1] : x[i] * 0.0;
+        r.push_back(left - x[i] * 2.0 + right + exp_(x[i]) * 0.1);
+    }
+    return r;
+}
+
+void run(std::size_t n) {
+    tape t;
+    tape::recording rec(t);
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    auto r = residuals(x);
+    var energy = r[0] * r[0];
+    for (std::size_t i = 1; i < n; ++i) energy = energy + r[i] * r[i];
+
+    auto dense = benchmark::measure([&] {
+        jacobian J(r, x);
+        benchmark::keep(J(0, 0));
+    }, 3);
+    benchmark::report("jacobian, dense", n, dense);
+    auto pattern = benchmark::measure([&] {
+        sparse_jacobian J(r, x);
+        benchmark::keep(J.matrix().values[0]);
+    }, 3);
+    benchmark::report("jacobian, pattern and values", n, pattern);
+    sparse_jacobian J(r, x);
+    auto values = benchmark::measure([&] {
+        J.evaluate();
+        benchmark::keep(J.matrix().values[0]);
+    });
+    benchmark::report("jacobian, values", n, values);
+    std::printf("%-28s %zu\n", "  colours", J.colours());
+
+    auto hdense = benchmark::measure([&] {
+        hessian H(energy, x);
+        benchmark::keep(H.matrix()[0]);
+    }, 3);
+    benchmark::report("hessian, dense", n, hdense);
+    sparse_hessian H(energy, x);
+    auto hvalues = benchmark::measure([&] {
+        H.evaluate();
+        benchmark::keep(H.matrix().values[0]);
+    });
+    benchmark::report("hessian, values", n, hvalues);
+    std::printf("%-28s %zu\n", "  colours", H.colours());
+}
+
+int main() {
+    for (std::size_t n : {100, 1000}) run(n);
+}
@@ -0,0 +1,73 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// sum_i x_i * x_{i+1} + sin(x_i), with the terms summed pairwise.
+var model(std::vector<var>& x) {
+    auto sin_ = functions::sin();
+    std::vector<var> terms;
+    terms.reserve(x.size());
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        terms.push_back(x[i] * x[i + 1] + sin_(x[i]));
+    }
+    while (terms.size() > 1) {
+        std::vector<var> next;
+        next.reserve(terms.size() / 2 + 1);
+        for (std::size_t i = 0; i + 1 < terms.size(); i += 2) {
+            next.push_back(terms[i] + terms[i + 1]);
+        }
+        if (terms.size() % 2) next.push_back(terms.back());
+        terms.swap(next);
+    }
+    return terms.front();
+}
+
+std::vector<var> inputs(std::size_t n) {
+    std::vector<var> x;
+    x.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.001 * i);
+    return x;
+}
+
+void tree(std::size_t n) {
+    auto r = benchmark::measure([n] {
+        auto x = inputs(n);
+        auto y = model(x);
+        auto G = gradient(y);
+        benchmark::keep(G[x[0]]);
+    });
+    benchmark::report("tree build+gradient", n, r);
+}
+
+void recorded(std::size_t n) {
+    tape t;
+    auto r = benchmark::measure([&t, n] {
+        t.clear();
+        tape::recording rec(t);
+        auto x = inputs(n);
+        auto y = model(x);
+        auto G = gradient(y);
+        benchmark::keep(G[x[0]]);
+    }, 3);
+    benchmark::report("tape build+gradient", n, r);
+
+    tape::recording rec(t);
+    auto x = inputs(n);
+    auto y = model(x);
+    auto s = benchmark::measure([&y] {
+        auto G = gradient(y);
+        benchmark::keep(G[y]);
+    }, 3);
+    benchmark::report("tape gradient only", n, s);
+}
+
+int main() {
+    for (std::size_t n : {1000, 4000, 100000, 1000000}) {
+        tree(n);
+        recorded(n);
+    }
+}
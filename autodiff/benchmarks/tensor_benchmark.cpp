@@ -0,0 +1,74 @@
+#include "benchmark.hpp"
+#include "gradient.hpp"
+#include "tensor.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+
+// sum(x y + exp(x) / y - sin(x)^2) and its gradient, element by element
+// with scalar vars and in one piece with arrays.
+void run(std::size_t n, bool tree) {
+    std::vector<double> xs(n);
+    std::vector<double> ys(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        xs[i] = std::sin(double(i)) * 0.5;
+        ys[i] = 1.5 + std::cos(double(i));
+    }
+
+    auto scalars = [&] {
+        auto exp_ = functions::exp();
+        auto sin_ = functions::sin();
+        std::vector<base::var> x;
+        std::vector<base::var> y;
+        x.reserve(n);
+        y.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            x.emplace_back(xs[i]);
+            y.emplace_back(ys[i]);
+        }
+        base::var f = x[0] * 0.0;
+        for (std::size_t i = 0; i < n; ++i) {
+            base::var s = sin_(x[i]);
+            f = f + x[i] * y[i] + exp_(x[i]) / y[i] - s * s;
+        }
+        base::gradient G(f);
+        benchmark::keep(G[x[0]]);
+    };
+    if (tree) {
+        benchmark::report("scalar vars, tree", n, benchmark::measure(scalars));
+    }
+    auto recorded = benchmark::measure([&] {
+        base::tape t;
+        base::tape::recording r(t);
+        t.reserve(16 * n);
+        scalars();
+    });
+    benchmark::report("scalar vars, tape", n, recorded);
+
+    auto arrays = benchmark::measure([&] {
+        tensor::array x(xs);
+        tensor::array y(ys);
+        tensor::array s = sin(x);
+        tensor::array f = sum(x * y + exp(x) / y - s * s);
+        tensor::gradient G(f);
+        benchmark::keep(G[x][0]);
+    }, 5);
+    benchmark::report("arrays", n, arrays);
+
+    tensor::array x(xs);
+    tensor::array y(ys);
+    tensor::array f = sum(x * y + x / y - x * x);
+    auto arithmetic = benchmark::measure([&] {
+        f.forward_pass();
+        tensor::gradient G(f);
+        benchmark::keep(G[x][0]);
+    }, 5);
+    benchmark::report("arrays, arithmetic only", n, arithmetic);
+}
+
+int main() {
+    run(10000, true);
+    run(1000000, false);
+}
@@ -0,0 +1,72 @@
+#include "arena.hpp"
+#include "benchmark.hpp"
+#include "gradient.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+const int per_thread = 2000;
+const std::size_t n = 64;
+
+// One independent gradient job: a small loss over n parameters, built
+// on whatever the calling thread has made active.
+double job() {
+    auto exp_ = functions::exp();
+    std::vector<var> x;
+    x.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.01 * i);
+    var loss(0.0);
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        loss = loss + exp_(x[i] * x[i + 1]) * 0.5;
+    }
+    auto G = gradient(loss);
+    return G[x[0]];
+}
+
+void tree() { benchmark::keep(job()); }
+
+void pooled() {
+    thread_local arena a;
+    {
+        arena::scope s(a);
+        benchmark::keep(job());
+    }
+    a.reset();
+}
+
+void recorded() {
+    thread_local tape t;
+    t.clear();
+    tape::recording r(t);
+    benchmark::keep(job());
+}
+
+template <typename F>
+void run(const char* name, int threads, F f) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([f] {
+            for (int j = 0; j < per_thread; ++j) f();
+        });
+    }
+    for (auto& w : workers) w.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::printf("%-8s threads=%-3d n=%-5zu %12.0f gradients/s\n", name,
+                threads, n, threads * per_thread / elapsed.count());
+}
+
+int main() {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= cores; threads *= 2) {
+        run("tree", threads, tree);
+        run("arena", threads, pooled);
+        run("tape", threads, recorded);
+    }
+}
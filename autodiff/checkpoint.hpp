@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "var.hpp"
+
+namespace autodiff {
+namespace base {
+
+// Gradients of a simulation that applies a step function many times to
+// a state, without holding the graph of every step at once. Only some
+// intermediate states are kept, as plain values; the reverse sweep
+// records a few steps at a time on a tape of its own, starting from the
+// nearest kept state and recomputing the steps in between.
+//
+// By default the kept states are placed in the binomial pattern of
+// Griewank's Revolve: with s snapshots, n steps are reversed with each
+// step evaluated at most t + 1 times for the least t with
+// C(s + t, s) >= n, so memory is traded for recomputation through s.
+// segments() keeps the states at given steps instead and records each
+// segment between them whole.
+class checkpoint {
+public:
+    // The state after step i, from the state before it.
+    using step = std::function<std::vector<var>(
+        const std::vector<var>& state, const std::vector<var>& parameters,
+        std::size_t i)>;
+    // The scalar that is differentiated, from the final state.
+    using objective = std::function<var(const std::vector<var>& state)>;
+
+    struct result {
+        double value = 0;
+        // d value / d initial state
+        std::vector<double> state;
+        // d value / d parameters
+        std::vector<double> parameters;
+    };
+
+    // What the last gradient() cost.
+    struct usage {
+        // steps evaluated, recorded or not
+        std::size_t evaluations = 0;
+        // kept states, besides the initial one
+        std::size_t peak_snapshots = 0;
+        std::size_t peak_records = 0;
+        // records and kept states together
+        std::size_t peak_bytes = 0;
+    };
+
+    checkpoint(step f, objective loss, std::size_t steps,
+               std::size_t snapshots)
+        : f_(std::move(f)), loss_(std::move(loss)), steps_(steps),
+          snapshots_(snapshots) {}
+
+    // Keeps at most n states besides the initial one, binomially placed.
+    void keep(std::size_t n) {
+        snapshots_ = n;
+        marks_.clear();
+        segmented_ = false;
+    }
+
+    // Keeps the states before the marked steps and records every segment
+    // between two marks whole. With no marks the whole simulation is
+    // one segment, as if it were recorded on a single tape.
+    void segments(std::vector<std::size_t> marks) {
+        std::sort(marks.begin(), marks.end());
+        marks.erase(std::unique(marks.begin(), marks.end()), marks.end());
+        marks_.clear();
+        for (std::size_t m : marks) {
+            if (m > 0 && m < steps_) marks_.push_back(m);
+        }
+        segmented_ = true;
+    }
+
+    result gradient(const std::vector<double>& x0,
+                    const std::vector<double>& parameters = {}) {
+        if (steps_ == 0) {
+            throw std::invalid_argument("autodiff: no steps to differentiate");
+        }
+        usage_ = usage{};
+        parameters_ = parameters;
+        result_ = result{0, std::vector<double>(x0.size(), 0.0),
+                         std::vector<double>(parameters.size(), 0.0)};
+        kept_.clear();
+        kept_.emplace(0, x0);
+        if (segmented_) {
+            by_segments();
+        } else {
+            binomial();
+        }
+        kept_.clear();
+        tape_.clear();
+        return result_;
+    }
+
+    const usage& last() const { return usage_; }
+
+private:
+    // A part [from, to) of the steps, reversed with the state at from
+    // kept and at most snapshots more.
+    struct part {
+        std::size_t from;
+        std::size_t to;
+        std::size_t snapshots;
+    };
+
+    // C(s + t, s), or n if that is larger.
+    static std::size_t beta(std::size_t s, std::size_t t, std::size_t n) {
+        std::size_t b = 1;
+        for (std::size_t k = 1; k <= s; ++k) {
+            b = b * (t + k) / k;
+            if (b >= n) return n;
+        }
+        return b;
+    }
+
+    void binomial() {
+        std::vector<part> pending{{0, steps_, snapshots_}};
+        while (!pending.empty()) {
+            part p = pending.back();
+            pending.pop_back();
+            const std::size_t n = p.to - p.from;
+            if (n > 1 && p.snapshots > 0) {
+                // the fewest repetitions t that reach n, then as many
+                // steps on the right as s - 1 snapshots reverse with t
+                std::size_t t = 1;
+                while (beta(p.snapshots, t, n) < n) ++t;
+                std::size_t right = std::min(n - 1,
+                                             beta(p.snapshots - 1, t, n));
+                std::size_t m = p.to - right;
+                std::vector<double> x = kept_.at(p.from);
+                advance(p.from, m, x);
+                kept_.emplace(m, std::move(x));
+                measure(0);
+                pending.push_back({p.from, m, p.snapshots});
+                pending.push_back({m, p.to, p.snapshots - 1});
+                continue;
+            }
+            // no snapshot to spare: every step from the kept state
+            for (std::size_t i = p.to; i-- > p.from;) {
+                std::vector<double> x = kept_.at(p.from);
+                advance(p.from, i, x);
+                reverse(i, i + 1, x);
+            }
+            kept_.erase(p.from);
+        }
+    }
+
+    void by_segments() {
+        std::vector<double> x = kept_.at(0);
+        std::size_t at = 0;
+        for (std::size_t m : marks_) {
+            advance(at, m, x);
+            kept_.emplace(m, x);
+            at = m;
+            measure(0);
+        }
+        std::size_t to = steps_;
+        for (std::size_t k = marks_.size() + 1; k-- > 0;) {
+            std::size_t from = k ? marks_[k - 1] : 0;
+            reverse(from, to, kept_.at(from));
+            kept_.erase(from);
+            to = from;
+        }
+    }
+
+    // Takes x from the state before step from to that before step to.
+    void advance(std::size_t from, std::size_t to, std::vector<double>& x) {
+        for (std::size_t i = from; i < to; ++i) {
+            tape_.clear();
+            tape::recording r(tape_);
+            std::vector<var> s = vars(x);
+            std::vector<var> q = vars(parameters_);
+            std::vector<var> y = checked(f_(s, q, i), x.size());
+            for (std::size_t k = 0; k < x.size(); ++k) x[k] = y[k].value();
+            ++usage_.evaluations;
+            measure(tape_.size());
+        }
+    }
+
+    // Records steps [from, to) from the state x before them and turns the
+    // adjoint of the state after them into that of x.
+    void reverse(std::size_t from, std::size_t to,
+                 const std::vector<double>& x) {
+        tape_.clear();
+        tape::recording r(tape_);
+        std::vector<var> s = vars(x);
+        std::vector<var> q = vars(parameters_);
+        std::vector<var> y = s;
+        for (std::size_t i = from; i < to; ++i) {
+            y = checked(f_(y, q, i), x.size());
+            ++usage_.evaluations;
+        }
+        // the adjoint of the state after step to - 1, carried in as
+        // the weights of a scalar
+        var head = to == steps_ ? loss_(y) : weighted(y);
+        if (to == steps_) result_.value = head.value();
+        measure(tape_.size());
+        tape_.backward(head.get_index(), adjoints_);
+        for (std::size_t k = 0; k < s.size(); ++k) {
+            result_.state[k] = adjoint(s[k]);
+        }
+        for (std::size_t k = 0; k < q.size(); ++k) {
+            result_.parameters[k] += adjoint(q[k]);
+        }
+    }
+
+    static std::vector<var> checked(std::vector<var> y, std::size_t n) {
+        if (y.size() != n) {
+            throw std::invalid_argument(
+                "autodiff: a step changed the size of the state");
+        }
+        return y;
+    }
+
+    var weighted(const std::vector<var>& y) const {
+        var head = y[0] * result_.state[0];
+        for (std::size_t k = 1; k < y.size(); ++k) {
+            head = head + y[k] * result_.state[k];
+        }
+        return head;
+    }
+
+    double adjoint(const var& x) const {
+        tape::index p = tape_.position(x.get_index());
+        return p < adjoints_.size() ? adjoints_[p] : 0;
+    }
+
+    static std::vector<var> vars(const std::vector<double>& values) {
+        std::vector<var> v;
+        v.reserve(values.size());
+        for (double d : values) v.emplace_back(d);
+        return v;
+    }
+
+    void measure(std::size_t records) {
+        const std::size_t kept = kept_.size() - (kept_.count(0) ? 1 : 0);
+        usage_.peak_snapshots = std::max(usage_.peak_snapshots, kept);
+        usage_.peak_records = std::max(usage_.peak_records, records);
+        std::size_t bytes = records * (sizeof(record) + sizeof(tape::index));
+        for (const auto& k : kept_) bytes += k.second.size() * sizeof(double);
+        usage_.peak_bytes = std::max(usage_.peak_bytes, bytes);
+    }
+
+    step f_;
+    objective loss_;
+    std::size_t steps_;
+    std::size_t snapshots_;
+    std::vector<std::size_t> marks_;
+    bool segmented_ = false;
+
+    tape tape_;
+    std::vector<double> adjoints_;
+    std::map<std::size_t, std::vector<double>> kept_;
+    std::vector<double> parameters_;
+    result result_;
+    usage usage_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "var.hpp"
+
+namespace autodiff {
+namespace codegen {
+
+using base::record;
+using base::tape;
+using base::var;
+
+// A graph flattened into straight-line form: records in evaluation
+// order, each referring to its operands by position, and the position of
+// every input, or none if the input does not take part.
+struct program {
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    std::vector<record> records;
+    std::vector<std::size_t> inputs;
+    std::size_t head = 0;
+};
+
+namespace detail {
+
+// An exact C++ literal for c.
+inline std::string literal(double c) {
+    if (std::isnan(c)) return "std::numeric_limits<double>::quiet_NaN()";
+    if (std::isinf(c)) {
+        return c > 0 ? "std::numeric_limits<double>::infinity()"
+                     : "-std::numeric_limits<double>::infinity()";
+    }
+    char s[32];
+    std::snprintf(s, sizeof s, "%a", c);
+    return s;
+}
+
+inline std::string v(std::size_t i) { return "v" + std::to_string(i); }
+inline std::string a(std::size_t i) { return "a" + std::to_string(i); }
+
+}  // namespace detail
+
+// Flattens the graph below y. Leaves that are not among the inputs are
+// treated as constants with their current values.
+inline program lower(var& y, const std::vector<var>& inputs) {
+    program p;
+    if (tape* t = y.get_tape()) {
+        p.head = t->position(y.get_index());
+        p.records.assign(&(*t)[0], &(*t)[0] + p.head + 1);
+        for (const var& x : inputs) {
+            std::size_t i = x.get_tape() == t ? t->position(x.get_index())
+                                              : program::none;
+            p.inputs.push_back(i <= p.head ? i : program::none);
+        }
+        return p;
+    }
+    auto head = y.node();
+    auto order = head->topological_order();
+    std::unordered_map<const var*, std::size_t> position;
+    for (var* n : order) {
+        record r{n->get_token().op(), 0, 0, 0};
+        if (n->arity()) {
+            // a fused sum or product as the chain of records it stands for
+            std::size_t last = position[n->term(0).get()];
+            for (std::size_t i = 1; i < n->arity(); ++i) {
+                r.lhs = static_cast<tape::index>(last);
+                r.rhs = static_cast<tape::index>(position[n->term(i).get()]);
+                last = p.records.size();
+                p.records.push_back(r);
+            }
+            position[n] = last;
+            continue;
+        }
+        if (n->left()) {
+            r.lhs = static_cast<tape::index>(position[n->left().get()]);
+            r.rhs = n->right() ? static_cast<tape::index>(
+                                     position[n->right().get()])
+                               : r.lhs;
+        } else {
+            r.value = n->value();
+        }
+        position[n] = p.records.size();
+        p.records.push_back(r);
+    }
+    p.head = p.records.size() - 1;
+    for (const var& x : inputs) {
+        auto i = position.find(x.identity());
+        p.inputs.push_back(i == position.end() ? program::none : i->second);
+    }
+    return p;
+}
+
+// The values of the leaves of p that are not inputs, in the order in
+// which emit() reads them from c when they are not baked in.
+inline std::vector<double> constants(const program& p) {
+    std::vector<char> input(p.records.size(), 0);
+    for (std::size_t i : p.inputs) {
+        if (i != program::none) input[i] = 1;
+    }
+    std::vector<double> c;
+    for (std::size_t i = 0; i <= p.head; ++i) {
+        opcode op = p.records[i].op;
+        if (op == opcode::constant || (op == opcode::variable && !input[i])) {
+            c.push_back(p.records[i].value);
+        }
+    }
+    return c;
+}
+
+// C++ for a function `name` with C linkage that returns the value of p
+// at the point x and writes d value / d x[i] to g[i]. The derivative
+// rules are those of var::propagate().
+//
+// With bake set, constants are written into the code and the signature
+// is double name(const double* x, double* g). Otherwise they are read
+// from an extra argument, double name(const double* x, const double* c,
+// double* g), laid out as constants() returns them, so the code depends
+// only on the structure of the graph.
+inline std::string emit(const program& p, const std::string& name,
+                        bool bake = true) {
+    using detail::a;
+    using detail::v;
+    const auto& rs = p.records;
+    std::vector<std::size_t> input(rs.size(), program::none);
+    for (std::size_t k = 0; k < p.inputs.size(); ++k) {
+        if (p.inputs[k] != program::none) input[p.inputs[k]] = k;
+    }
+    auto varies = [&](std::size_t i) {
+        return rs[i].op != opcode::constant &&
+               (rs[i].op != opcode::variable || input[i] != program::none);
+    };
+    std::size_t next = 0;
+    auto constant = [&](double c) {
+        return bake ? detail::literal(c)
+                    : "c[" + std::to_string(next++) + "]";
+    };
+
+    std::string s;
+    s += "#include <cmath>\n#include <limits>\n\n";
+    s += "#if defined(_WIN32)\n__declspec(dllexport)\n#endif\n";
+    s += "extern \"C\" double " + name + "(const double* x, " +
+         (bake ? "" : "const double* c, ") + "double* g) {\n";
+    for (std::size_t i = 0; i <= p.head; ++i) {
+        const record& r = rs[i];
+        std::string l = v(r.lhs);
+        std::string d = v(r.rhs);
+        std::string e;
+        switch (r.op) {
+            case opcode::variable:
+                e = input[i] != program::none
+                        ? "x[" + std::to_string(input[i]) + "]"
+                        : constant(r.value);
+                break;
+            case opcode::constant: e = constant(r.value); break;
+            case opcode::add: e = l + " + " + d; break;
+            case opcode::sub: e = l + " - " + d; break;
+            case opcode::mul: e = l + " * " + d; break;
+            case opcode::div: e = l + " / " + d; break;
+            case opcode::neg: e = "-" + l; break;
+            case opcode::exp: e = "std::exp(" + l + ")"; break;
+            case opcode::sin: e = "std::sin(" + l + ")"; break;
+            case opcode::cos: e = "std::cos(" + l + ")"; break;
+            case opcode::ln: e = "std::log(" + l + ")"; break;
+            case opcode::log: e = "std::log(" + l + ") / std::log(2.0)"; break;
+            case opcode::pow: e = "std::pow(" + l + ", " + d + ")"; break;
+            default: e = "0.0"; break;
+        }
+        s += "    const double " + v(i) + " = " + e + ";\n";
+    }
+
+    for (std::size_t i = 0; i <= p.head; ++i) {
+        if (varies(i)) {
+            s += "    double " + a(i) + " = " + (i == p.head ? "1.0" : "0.0") +
+                 ";\n";
+        }
+    }
+    for (std::size_t i = p.head + 1; i-- > 0;) {
+        const record& r = rs[i];
+        if (!varies(i) || r.op == opcode::variable) continue;
+        std::string l = v(r.lhs);
+        std::string d = v(r.rhs);
+        std::string dl;
+        std::string dr;
+        switch (r.op) {
+            case opcode::add: dl = a(i); dr = a(i); break;
+            case opcode::sub: dl = a(i); dr = "-" + a(i); break;
+            case opcode::mul: dl = a(i) + " * " + d; dr = a(i) + " * " + l; break;
+            case opcode::div:
+                dl = a(i) + " * (1.0 / " + d + ")";
+                dr = "-(" + a(i) + " * (" + l + " / (" + d + " * " + d + ")))";
+                break;
+            case opcode::neg: dl = "-" + a(i); break;
+            case opcode::exp: dl = a(i) + " * " + v(i); break;
+            case opcode::sin: dl = a(i) + " * std::cos(" + l + ")"; break;
+            case opcode::cos: dl = "-(" + a(i) + " * std::sin(" + l + "))"; break;
+            case opcode::ln: dl = a(i) + " * (1 / " + l + ")"; break;
+            case opcode::log:
+                dl = a(i) + " * (1 / (" + l + " * std::log(2.0)))";
+                break;
+            case opcode::pow:
+                dl = a(i) + " * " + d + " * std::pow(" + l + ", " + d + " - 1)";
+                dr = a(i) + " * " + v(i) + " * std::log(" + l + ")";
+                break;
+            default: break;
+        }
+        if (!dl.empty() && varies(r.lhs)) {
+            s += "    " + a(r.lhs) + " += " + dl + ";\n";
+        }
+        if (!dr.empty() && tape::is_binary(r.op) && varies(r.rhs)) {
+            s += "    " + a(r.rhs) + " += " + dr + ";\n";
+        }
+    }
+    for (std::size_t k = 0; k < p.inputs.size(); ++k) {
+        std::size_t i = p.inputs[k];
+        s += "    g[" + std::to_string(k) + "] = " +
+             (i != program::none ? a(i) : std::string("0.0")) + ";\n";
+    }
+    s += "    return " + v(p.head) + ";\n}\n";
+    return s;
+}
+
+// The source of a function `name` computing y and its gradient with
+// respect to inputs, in that order, as described for emit().
+inline std::string generate(var& y, const std::vector<var>& inputs,
+                            const std::string& name) {
+    return emit(lower(y, inputs), name);
+}
+
+}  // namespace codegen
+}  // namespace autodiff
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "token.hpp"
+
+namespace autodiff {
+namespace base {
+
+class var;
+
+// What makes two operations the same: the opcode, the identities of the
+// operands and, for constants, the value. Operands of + and * are put in
+// a fixed order so that a * b and b * a coincide.
+struct shape {
+    opcode op;
+    std::uintptr_t lhs;
+    std::uintptr_t rhs;
+    std::uint64_t bits;
+
+    static shape of(opcode op, std::uintptr_t lhs, std::uintptr_t rhs) {
+        if ((op == opcode::add || op == opcode::mul) && rhs < lhs) {
+            std::swap(lhs, rhs);
+        }
+        return shape{op, lhs, rhs, 0};
+    }
+
+    static shape of(double c) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &c, sizeof bits);
+        return shape{opcode::constant, 0, 0, bits};
+    }
+
+    bool operator==(const shape& o) const {
+        return op == o.op && lhs == o.lhs && rhs == o.rhs && bits == o.bits;
+    }
+
+    struct hash {
+        std::size_t operator()(const shape& s) const {
+            std::size_t h = static_cast<std::size_t>(s.op);
+            for (std::uint64_t v : {std::uint64_t(s.lhs),
+                                    std::uint64_t(s.rhs), s.bits}) {
+                h ^= std::hash<std::uint64_t>()(v) + 0x9e3779b97f4a7c15ULL +
+                     (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+};
+
+// Hash-consing for tree nodes. While a table is active on a thread, the
+// var operators on that thread look every new operation and constant up
+// by its shape and hand back the live node already built for it, so a
+// repeated subexpression becomes one shared node of the DAG.
+//
+// The table only observes nodes; clear() it, or let it go, once the
+// graphs built under it are done with, since an entry keeps the memory
+// of a dead node's control block. For the same reason it cannot be used
+// while an arena is active, which would recycle that memory on reset();
+// building a node with both active throws.
+class cse {
+public:
+    // Makes a table the active one on this thread for its lifetime and
+    // restores the previously active table afterwards.
+    class scope {
+    public:
+        explicit scope(cse& c) : previous_(slot()) { slot() = &c; }
+        ~scope() { slot() = previous_; }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        cse* previous_;
+    };
+
+    cse() = default;
+    cse(const cse&) = delete;
+    cse& operator=(const cse&) = delete;
+
+    static cse* active() { return slot(); }
+
+    std::shared_ptr<var> find(const shape& s) {
+        auto n = nodes_.find(s);
+        if (n == nodes_.end()) return nullptr;
+        if (auto live = n->second.lock()) return live;
+        nodes_.erase(n);
+        return nullptr;
+    }
+
+    void insert(const shape& s, const std::shared_ptr<var>& node) {
+        nodes_[s] = node;
+    }
+
+    std::size_t size() const { return nodes_.size(); }
+    void clear() { nodes_.clear(); }
+
+private:
+    static cse*& slot() {
+        static thread_local cse* active = nullptr;
+        return active;
+    }
+
+    std::unordered_map<shape, std::weak_ptr<var>, shape::hash> nodes_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+namespace autodiff {
+namespace forward {
+
+// A fixed number of tangents pushed through one evaluation side by side.
+// Every operation is a plain loop over N lanes of a suitably aligned
+// array, which the compiler turns into SSE, AVX2 or AVX-512 instructions
+// depending on the target (see AUTODIFF_NATIVE).
+template <typename T, std::size_t N>
+class lanes {
+public:
+    static constexpr std::size_t size() { return N; }
+
+    lanes() : lanes(T(0)) {}
+    lanes(T c) {
+        for (std::size_t i = 0; i < N; ++i) x_[i] = c;
+    }
+
+    T& operator[](std::size_t i) { return x_[i]; }
+    const T& operator[](std::size_t i) const { return x_[i]; }
+
+    friend lanes operator+(const lanes& l, const lanes& r) {
+        lanes o;
+        for (std::size_t i = 0; i < N; ++i) o.x_[i] = l.x_[i] + r.x_[i];
+        return o;
+    }
+    friend lanes operator-(const lanes& l, const lanes& r) {
+        lanes o;
+        for (std::size_t i = 0; i < N; ++i) o.x_[i] = l.x_[i] - r.x_[i];
+        return o;
+    }
+    friend lanes operator*(const lanes& l, const T& c) {
+        lanes o;
+        for (std::size_t i = 0; i < N; ++i) o.x_[i] = l.x_[i] * c;
+        return o;
+    }
+    friend lanes operator*(const T& c, const lanes& r) { return r * c; }
+    friend lanes operator/(const lanes& l, const T& c) {
+        lanes o;
+        for (std::size_t i = 0; i < N; ++i) o.x_[i] = l.x_[i] / c;
+        return o;
+    }
+    friend lanes operator-(const lanes& v) {
+        lanes o;
+        for (std::size_t i = 0; i < N; ++i) o.x_[i] = -v.x_[i];
+        return o;
+    }
+
+private:
+    // the widest power of two, up to a 512-bit register, dividing the
+    // array, so that whole vectors can be loaded aligned
+    static constexpr std::size_t alignment() {
+        std::size_t a = alignof(T);
+        while (a < 64 && (sizeof(T) * N) % (2 * a) == 0) a *= 2;
+        return a;
+    }
+
+    alignas(alignment()) T x_[N];
+};
+
+// A forward-mode number: a value together with its derivative along one
+// direction. Arithmetic on duals carries the tangent with the value, so
+// one evaluation yields the directional derivative without recording a
+// graph. T may itself be a dual, which nests the derivatives. D is the
+// tangent type: T for one direction, or lanes<T, N> to carry N directions
+// through the same primal work.
+template <typename T, typename D = T>
+class dual {
+public:
+    using value_type = T;
+    using tangent_type = D;
+
+    dual() : v_(0), t_(0) {}
+    dual(T v) : v_(v), t_(0) {}
+    dual(T v, D t) : v_(v), t_(t) {}
+
+    const T& value() const { return v_; }
+    const D& tangent() const { return t_; }
+    void set_value(T v) { v_ = v; }
+    void set_tangent(D t) { t_ = t; }
+
+    friend dual operator+(const dual& l, const dual& r) {
+        return dual(l.v_ + r.v_, l.t_ + r.t_);
+    }
+    friend dual operator+(const dual& l, const T& c) {
+        return dual(l.v_ + c, l.t_);
+    }
+    friend dual operator+(const T& c, const dual& r) {
+        return dual(c + r.v_, r.t_);
+    }
+
+    friend dual operator-(const dual& l, const dual& r) {
+        return dual(l.v_ - r.v_, l.t_ - r.t_);
+    }
+    friend dual operator-(const dual& l, const T& c) {
+        return dual(l.v_ - c, l.t_);
+    }
+    friend dual operator-(const T& c, const dual& r) {
+        return dual(c - r.v_, -r.t_);
+    }
+
+    friend dual operator*(const dual& l, const dual& r) {
+        return dual(l.v_ * r.v_, l.t_ * r.v_ + l.v_ * r.t_);
+    }
+    friend dual operator*(const dual& l, const T& c) {
+        return dual(l.v_ * c, l.t_ * c);
+    }
+    friend dual operator*(const T& c, const dual& r) {
+        return dual(c * r.v_, c * r.t_);
+    }
+
+    friend dual operator/(const dual& l, const dual& r) {
+        T q = l.v_ / r.v_;
+        return dual(q, (l.t_ - q * r.t_) / r.v_);
+    }
+    friend dual operator/(const dual& l, const T& c) {
+        return dual(l.v_ / c, l.t_ / c);
+    }
+    friend dual operator/(const T& c, const dual& r) {
+        T q = c / r.v_;
+        return dual(q, r.t_ * (-q / r.v_));
+    }
+
+    friend dual operator-(const dual& v) { return dual(-v.v_, -v.t_); }
+
+    dual& operator+=(const dual& r) { return *this = *this + r; }
+    dual& operator-=(const dual& r) { return *this = *this - r; }
+    dual& operator*=(const dual& r) { return *this = *this * r; }
+    dual& operator/=(const dual& r) { return *this = *this / r; }
+
+private:
+    T v_;
+    D t_;
+};
+
+// The dual with N tangent lanes.
+template <typename T, std::size_t N>
+using dual_n = dual<T, lanes<T, N>>;
+
+// An input of an N-lane evaluation: value v, unit tangent in lane i. Seeding
+// each of N inputs in its own lane gives the whole gradient in one pass.
+template <std::size_t N, typename T>
+dual_n<T, N> seed(T v, std::size_t i) {
+    lanes<T, N> t;
+    t[i] = T(1);
+    return dual_n<T, N>(v, t);
+}
+
+// The elementary functions of functions::*, with the same meaning: ln is
+// the natural logarithm and log the base-2 one.
+
+inline double ln(double x) { return std::log(x); }
+
+template <typename T, typename D>
+dual<T, D> exp(const dual<T, D>& x) {
+    using std::exp;
+    T e = exp(x.value());
+    return dual<T, D>(e, e * x.tangent());
+}
+
+template <typename T, typename D>
+dual<T, D> sin(const dual<T, D>& x) {
+    using std::cos;
+    using std::sin;
+    return dual<T, D>(sin(x.value()), cos(x.value()) * x.tangent());
+}
+
+template <typename T, typename D>
+dual<T, D> cos(const dual<T, D>& x) {
+    using std::cos;
+    using std::sin;
+    return dual<T, D>(cos(x.value()), -sin(x.value()) * x.tangent());
+}
+
+template <typename T, typename D>
+dual<T, D> ln(const dual<T, D>& x) {
+    return dual<T, D>(ln(x.value()), x.tangent() / x.value());
+}
+
+template <typename T, typename D>
+dual<T, D> log(const dual<T, D>& x) {
+    return dual<T, D>(ln(x.value()) / std::log(2.0),
+                      x.tangent() / (x.value() * std::log(2.0)));
+}
+
+// Whether a tangent is zero in every lane and at every level.
+inline bool is_zero(double t) { return t == 0; }
+
+template <typename T, std::size_t N>
+bool is_zero(const lanes<T, N>& t) {
+    for (std::size_t i = 0; i < N; ++i) {
+        if (!is_zero(t[i])) return false;
+    }
+    return true;
+}
+
+template <typename T, typename D>
+bool is_zero(const dual<T, D>& t) {
+    return is_zero(t.value()) && is_zero(t.tangent());
+}
+
+// c * t, left out wherever t is zero: the partial c of pow is NaN or
+// infinite at bases that only the other operand's direction reaches,
+// e.g. ln(x) for x <= 0 when the exponent is constant.
+template <typename T, typename D>
+D along(const T& c, const D& t) {
+    return is_zero(t) ? D(0) : c * t;
+}
+
+template <typename T, std::size_t N>
+lanes<T, N> along(const T& c, const lanes<T, N>& t) {
+    lanes<T, N> o;
+    for (std::size_t i = 0; i < N; ++i) o[i] = along(c, t[i]);
+    return o;
+}
+
+template <typename T, typename D>
+dual<T, D> pow(const dual<T, D>& x, const dual<T, D>& y) {
+    using std::pow;
+    T p = pow(x.value(), y.value());
+    return dual<T, D>(
+        p, along(y.value() * pow(x.value(), y.value() - 1), x.tangent()) +
+               along(p * ln(x.value()), y.tangent()));
+}
+
+template <typename T, typename D>
+dual<T, D> pow(const dual<T, D>& x,
+               const typename dual<T, D>::value_type& c) {
+    using std::pow;
+    return dual<T, D>(pow(x.value(), c),
+                      c * pow(x.value(), c - 1) * x.tangent());
+}
+
+template <typename T, typename D>
+dual<T, D> pow(const typename dual<T, D>::value_type& c,
+               const dual<T, D>& y) {
+    using std::pow;
+    T p = pow(c, y.value());
+    return dual<T, D>(p, along(p * ln(c), y.tangent()));
+}
+
+}  // namespace forward
+}  // namespace autodiff
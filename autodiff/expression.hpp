@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace autodiff {
+namespace expression {
+
+// Expression templates for small fixed formulas. Combining expressions
+// builds a type that spells out the formula, so arg<0>() * arg<1>() is a
+// binary<op::mul, arg<0>, arg<1>>, and evaluate() runs its forward and
+// reverse passes fully inlined on the stack without allocating. The
+// operations and their derivatives are those of base::var; ln is the
+// natural logarithm and log the base-2 one.
+
+template <typename E>
+struct node {
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// The i-th input of the formula.
+template <std::size_t I>
+class arg : public node<arg<I>> {
+public:
+    static constexpr std::size_t arity = I + 1;
+
+    double forward(const double* x) { return v_ = x[I]; }
+    void backward(double a, double* g) const { g[I] += a; }
+    double value() const { return v_; }
+
+private:
+    double v_ = 0;
+};
+
+class constant : public node<constant> {
+public:
+    static constexpr std::size_t arity = 0;
+
+    explicit constant(double c) : v_(c) {}
+
+    double forward(const double*) { return v_; }
+    void backward(double, double*) const {}
+    double value() const { return v_; }
+
+private:
+    double v_;
+};
+
+// Each operation gives its value and its partials with respect to the
+// left and right operand, which may use the value already computed.
+namespace op {
+
+struct add {
+    static double apply(double l, double r) { return l + r; }
+    static double left(double, double, double) { return 1; }
+    static double right(double, double, double) { return 1; }
+};
+struct sub {
+    static double apply(double l, double r) { return l - r; }
+    static double left(double, double, double) { return 1; }
+    static double right(double, double, double) { return -1; }
+};
+struct mul {
+    static double apply(double l, double r) { return l * r; }
+    static double left(double, double r, double) { return r; }
+    static double right(double l, double, double) { return l; }
+};
+struct div {
+    static double apply(double l, double r) { return l / r; }
+    static double left(double, double r, double) { return 1.0 / r; }
+    static double right(double l, double r, double) { return -l / (r * r); }
+};
+struct pow {
+    static double apply(double l, double r) { return std::pow(l, r); }
+    static double left(double l, double r, double) {
+        return r * std::pow(l, r - 1);
+    }
+    static double right(double l, double, double v) {
+        return v * std::log(l);
+    }
+};
+struct neg {
+    static double apply(double x) { return -x; }
+    static double derivative(double, double) { return -1; }
+};
+struct exp {
+    static double apply(double x) { return std::exp(x); }
+    static double derivative(double, double v) { return v; }
+};
+struct sin {
+    static double apply(double x) { return std::sin(x); }
+    static double derivative(double x, double) { return std::cos(x); }
+};
+struct cos {
+    static double apply(double x) { return std::cos(x); }
+    static double derivative(double x, double) { return -std::sin(x); }
+};
+struct ln {
+    static double apply(double x) { return std::log(x); }
+    static double derivative(double x, double) { return 1 / x; }
+};
+struct log {
+    static double apply(double x) { return std::log(x) / std::log(2); }
+    static double derivative(double x, double) {
+        return 1 / (x * std::log(2));
+    }
+};
+
+}  // namespace op
+
+template <typename Op, typename L, typename R>
+class binary : public node<binary<Op, L, R>> {
+public:
+    static constexpr std::size_t arity = std::max(L::arity, R::arity);
+
+    binary(const L& l, const R& r) : l_(l), r_(r) {}
+
+    double forward(const double* x) {
+        return v_ = Op::apply(l_.forward(x), r_.forward(x));
+    }
+    void backward(double a, double* g) const {
+        double l = l_.value();
+        double r = r_.value();
+        l_.backward(a * Op::left(l, r, v_), g);
+        r_.backward(a * Op::right(l, r, v_), g);
+    }
+    double value() const { return v_; }
+
+private:
+    L l_;
+    R r_;
+    double v_ = 0;
+};
+
+template <typename Op, typename E>
+class unary : public node<unary<Op, E>> {
+public:
+    static constexpr std::size_t arity = E::arity;
+
+    explicit unary(const E& e) : e_(e) {}
+
+    double forward(const double* x) { return v_ = Op::apply(e_.forward(x)); }
+    void backward(double a, double* g) const {
+        e_.backward(a * Op::derivative(e_.value(), v_), g);
+    }
+    double value() const { return v_; }
+
+private:
+    E e_;
+    double v_ = 0;
+};
+
+template <typename L, typename R>
+binary<op::add, L, R> operator+(const node<L>& l, const node<R>& r) {
+    return {l.self(), r.self()};
+}
+template <typename L>
+binary<op::add, L, constant> operator+(const node<L>& l, double c) {
+    return {l.self(), constant(c)};
+}
+template <typename R>
+binary<op::add, constant, R> operator+(double c, const node<R>& r) {
+    return {constant(c), r.self()};
+}
+
+template <typename L, typename R>
+binary<op::sub, L, R> operator-(const node<L>& l, const node<R>& r) {
+    return {l.self(), r.self()};
+}
+template <typename L>
+binary<op::sub, L, constant> operator-(const node<L>& l, double c) {
+    return {l.self(), constant(c)};
+}
+template <typename R>
+binary<op::sub, constant, R> operator-(double c, const node<R>& r) {
+    return {constant(c), r.self()};
+}
+
+template <typename L, typename R>
+binary<op::mul, L, R> operator*(const node<L>& l, const node<R>& r) {
+    return {l.self(), r.self()};
+}
+template <typename L>
+binary<op::mul, L, constant> operator*(const node<L>& l, double c) {
+    return {l.self(), constant(c)};
+}
+template <typename R>
+binary<op::mul, constant, R> operator*(double c, const node<R>& r) {
+    return {constant(c), r.self()};
+}
+
+template <typename L, typename R>
+binary<op::div, L, R> operator/(const node<L>& l, const node<R>& r) {
+    return {l.self(), r.self()};
+}
+template <typename L>
+binary<op::div, L, constant> operator/(const node<L>& l, double c) {
+    return {l.self(), constant(c)};
+}
+template <typename R>
+binary<op::div, constant, R> operator/(double c, const node<R>& r) {
+    return {constant(c), r.self()};
+}
+
+template <typename E>
+unary<op::neg, E> operator-(const node<E>& e) {
+    return unary<op::neg, E>(e.self());
+}
+
+// Found by argument-dependent lookup, which is how the functions::
+// functors reach them.
+template <typename E>
+unary<op::exp, E> exp(const node<E>& e) {
+    return unary<op::exp, E>(e.self());
+}
+template <typename E>
+unary<op::sin, E> sin(const node<E>& e) {
+    return unary<op::sin, E>(e.self());
+}
+template <typename E>
+unary<op::cos, E> cos(const node<E>& e) {
+    return unary<op::cos, E>(e.self());
+}
+template <typename E>
+unary<op::ln, E> ln(const node<E>& e) {
+    return unary<op::ln, E>(e.self());
+}
+template <typename E>
+unary<op::log, E> log(const node<E>& e) {
+    return unary<op::log, E>(e.self());
+}
+template <typename L, typename R>
+binary<op::pow, L, R> pow(const node<L>& l, const node<R>& r) {
+    return {l.self(), r.self()};
+}
+template <typename L>
+binary<op::pow, L, constant> pow(const node<L>& l, double c) {
+    return {l.self(), constant(c)};
+}
+template <typename R>
+binary<op::pow, constant, R> pow(double c, const node<R>& r) {
+    return {constant(c), r.self()};
+}
+
+template <std::size_t N>
+struct result {
+    double value;
+    std::array<double, N> gradient;
+};
+
+template <typename E>
+double value(const node<E>& f, const std::array<double, E::arity>& x) {
+    E e = f.self();
+    return e.forward(x.data());
+}
+
+// The value of f at x and its gradient with respect to every arg.
+template <typename E>
+result<E::arity> evaluate(const node<E>& f,
+                          const std::array<double, E::arity>& x) {
+    E e = f.self();
+    result<E::arity> r{e.forward(x.data()), {}};
+    e.backward(1.0, r.gradient.data());
+    return r;
+}
+
+}  // namespace expression
+}  // namespace autodiff
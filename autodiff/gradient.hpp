@@ -1,3 +1,5 @@
+#include <unordered_map>
+
 #include "var.hpp"
 
 namespace autodiff {
@@ -6,29 +8,51 @@ namespace base {
 class gradient {
 public:
     gradient(var v) {
+        if (v.get_tape()) {
+            // recorded: one reverse sweep over the tape
+            tape_ = v.get_tape();
+            index_ = v.get_index();
+            grad();
+            return;
+        }
         // set head
-        head_ = std::make_shared<var>(v);
+        head_ = v.node();
+        // every node once, children before parents
+        order_ = head_->topological_order();
         // populate variables
-        populate_variables(head_);
+        for (var* n : order_) {
+            if (!n->left() && !n->right() && !n->arity()) {
+                variables_.push_back(std::shared_ptr<var>(head_, n));
+            }
+        }
         // fire off gradient
         grad();
     }
 
-    double operator[](var& x) { return gradients_[&x]; }
+    double operator[](var& x) {
+        if (tape_) {
+            if (x.get_tape() != tape_) return 0;
+            tape::index p = tape_->position(x.get_index());
+            return p < adjoints_.size() ? adjoints_[p] : 0;
+        }
+        auto g = gradients_.find(x.identity());
+        return g == gradients_.end() ? 0 : g->second;
+    }
 
     void grad() {
-        head_->clean_grad();
+        if (tape_) {
+            tape_->backward(index_, adjoints_);
+            return;
+        }
+        for (var* n : order_) n->grad_ = 0;
         head_->set_gradient(1.0);
-        head_->grad();
-        // collect contributions
+        for (auto n = order_.rbegin(); n != order_.rend(); ++n) {
+            (*n)->propagate();
+        }
+        // every copy of a variable shares its node, so the adjoint has
+        // already been accumulated there
         for (const auto& v : variables_) {
-            for(const auto& w : var::aliases) {
-                for(const auto& r : w.second) {
-                    if(r == v) {
-                        gradients_[w.first] += r->grad_;
-                    }
-                }
-            }
+            gradients_[v.get()] = v->grad_;
         }
     }
 
@@ -42,19 +66,13 @@ public:
     std::list<std::shared_ptr<var>> variables() { return variables_; }
 
 private:
-    void populate_variables(const std::shared_ptr<var>& root) {
-        if (!root) return;
-        if (!root->left() && !root->right()) {
-            variables_.push_back(root);
-            return;
-        }
-        if (root->left()) populate_variables(root->left());
-        if (root->right()) populate_variables(root->right());
-    }
-
     std::shared_ptr<var> head_;
+    std::vector<var*> order_;
     std::list<std::shared_ptr<var>> variables_;
-    std::map<const var *, double> gradients_;
+    std::unordered_map<const var *, double> gradients_;
+    tape* tape_ = nullptr;
+    tape::index index_ = 0;
+    std::vector<double> adjoints_;
 };
 }  // namespace base
 }  // namespace autodiff
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "var.hpp"
+
+namespace autodiff {
+namespace base {
+
+// The records that a set of outputs depends on, in evaluation order,
+// together with where each output and input sits among them. Recorded
+// vars are read in place from their tape; tree vars are flattened once
+// into a copy, every shared node a single record. Derivative sweeps over
+// several outputs or inputs then run over plain arrays, with every var
+// resolved to a position up front.
+class graph {
+public:
+    using index = tape::index;
+    // the position of an input the outputs do not depend on
+    static constexpr index none = std::numeric_limits<index>::max();
+
+    graph(const std::vector<var>& outputs, const std::vector<var>& inputs) {
+        if (outputs.empty()) {
+            throw std::invalid_argument("autodiff: graph needs outputs");
+        }
+        if (tape* t = outputs[0].get_tape()) {
+            from_tape(*t, outputs, inputs);
+        } else {
+            from_tree(outputs, inputs);
+        }
+        for (std::size_t k = 0; k < outputs_.size(); ++k) {
+            if (outputs_[k] >= outputs_[last_]) last_ = k;
+        }
+        end_ = outputs_[last_] + std::size_t(1);
+        if (tape_) last_index_ = outputs[last_].get_index();
+    }
+
+    graph(const graph&) = delete;
+    graph& operator=(const graph&) = delete;
+
+    // Records [0, size()) hold everything any output depends on.
+    std::size_t size() const { return end_; }
+    const record& operator[](index p) const { return records_[p]; }
+
+    const std::vector<index>& outputs() const { return outputs_; }
+    const std::vector<index>& inputs() const { return inputs_; }
+
+    // Re-evaluates a recorded graph from the current values of its
+    // variables; call it too after recording more onto the tape. Tree
+    // graphs are a snapshot of the values they were flattened with.
+    void forward() {
+        if (!tape_) return;
+        records_ = &(*tape_)[0];
+        tape_->forward(last_index_);
+    }
+
+private:
+    void from_tape(tape& t, const std::vector<var>& outputs,
+                   const std::vector<var>& inputs) {
+        tape_ = &t;
+        records_ = &t[0];
+        for (const var& y : outputs) {
+            if (y.get_tape() != &t) {
+                throw std::logic_error(
+                    "autodiff: outputs live on different tapes");
+            }
+            outputs_.push_back(t.position(y.get_index()));
+        }
+        for (const var& x : inputs) {
+            inputs_.push_back(x.get_tape() == &t ? t.position(x.get_index())
+                                                 : none);
+        }
+    }
+
+    void from_tree(const std::vector<var>& outputs,
+                   const std::vector<var>& inputs) {
+        std::unordered_map<const var*, index> position;
+        // held until the end, so that no address in position is reused
+        std::vector<std::shared_ptr<var>> heads;
+        for (const var& y : outputs) {
+            if (y.get_tape()) {
+                throw std::logic_error(
+                    "autodiff: outputs live on different tapes");
+            }
+            auto head = y.node();
+            for (var* n : head->topological_order()) {
+                if (position.count(n)) continue;
+                if (n->arity()) {
+                    position.emplace(n, chain(*n, position));
+                    continue;
+                }
+                record r{n->get_token().op(), 0, 0, n->value()};
+                if (n->left()) {
+                    r.lhs = position.at(n->left().get());
+                    r.rhs = n->right() ? position.at(n->right().get())
+                                       : r.lhs;
+                }
+                position.emplace(n, static_cast<index>(local_.size()));
+                local_.push_back(r);
+            }
+            outputs_.push_back(position.at(head.get()));
+            heads.push_back(std::move(head));
+        }
+        for (const var& x : inputs) {
+            auto p = position.find(x.identity());
+            inputs_.push_back(p == position.end() ? none : p->second);
+        }
+        records_ = local_.data();
+    }
+
+    // Spells a fused sum or product out as the chain of binary records
+    // it stands for and returns the position of the last.
+    index chain(var& n, const std::unordered_map<const var*, index>& position) {
+        const opcode op = n.get_token().op();
+        index last = position.at(n.term(0).get());
+        double v = local_[last].value;
+        for (std::size_t i = 1; i < n.arity(); ++i) {
+            index t = position.at(n.term(i).get());
+            v = op == opcode::add ? v + local_[t].value : v * local_[t].value;
+            local_.push_back(record{op, last, t, v});
+            last = static_cast<index>(local_.size() - 1);
+        }
+        return last;
+    }
+
+    tape* tape_ = nullptr;
+    const record* records_ = nullptr;
+    std::size_t end_ = 0;
+    std::size_t last_ = 0;
+    index last_index_ = 0;
+    std::vector<index> outputs_;
+    std::vector<index> inputs_;
+    std::vector<record> local_;
+};
+
+}  // namespace base
+}  // namespace autodiff
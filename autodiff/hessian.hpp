@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace autodiff {
+namespace base {
+
+// Second derivatives of one output by forward-over-reverse: a tangent
+// sweep along v followed by one reverse sweep that carries, next to every
+// adjoint, its derivative along v. That yields the gradient and H v
+// together for about the cost of two gradients; the full matrix takes one
+// such product per input.
+class hessian {
+public:
+    hessian(const var& y, const std::vector<var>& inputs)
+        : graph_({y}, inputs), n_(inputs.size()), varies_(graph_.size(), 0) {
+        // which records depend on an input; the rest get no adjoint, so
+        // a partial that is NaN there (a constant exponent of a negative
+        // base) never reaches the result
+        for (index p : graph_.inputs()) {
+            if (p != graph::none) varies_[p] = 1;
+        }
+        for (std::size_t i = 0; i < graph_.size(); ++i) {
+            const record& r = graph_[static_cast<index>(i)];
+            if (r.op == opcode::variable || r.op == opcode::constant) continue;
+            varies_[i] = varies_[r.lhs] ||
+                         (tape::is_binary(r.op) && varies_[r.rhs]);
+        }
+    }
+
+    std::size_t size() const { return n_; }
+    const graph& get_graph() const { return graph_; }
+
+    // Writes H v to hv, and the gradient to g if given.
+    void product(const double* v, double* hv, double* g = nullptr) {
+        const graph& gr = graph_;
+        const std::size_t end = gr.size();
+        tangents_.assign(end, 0.0);
+        for (std::size_t j = 0; j < n_; ++j) {
+            index p = gr.inputs()[j];
+            if (p != graph::none) tangents_[p] += v[j];
+        }
+        for (std::size_t i = 0; i < end; ++i) {
+            const record& r = gr[static_cast<index>(i)];
+            if (r.op == opcode::variable || r.op == opcode::constant) continue;
+            const double tl = tangents_[r.lhs];
+            const double tr = tape::is_binary(r.op) ? tangents_[r.rhs] : 0;
+            if (tl == 0 && tr == 0) continue;
+            double dl;
+            double dr;
+            tape::partials(r, gr[r.lhs].value, gr[r.rhs].value, dl, dr);
+            tangents_[i] = (tl != 0 ? dl * tl : 0) + (tr != 0 ? dr * tr : 0);
+        }
+
+        adjoints_.assign(end, 0.0);
+        dots_.assign(end, 0.0);
+        adjoints_[end - 1] = 1.0;
+        for (std::size_t i = end; i-- > 0;) {
+            const double a = adjoints_[i];
+            const double da = dots_[i];
+            if (a == 0 && da == 0) continue;
+            const record& r = gr[static_cast<index>(i)];
+            if (r.op == opcode::variable || r.op == opcode::constant) continue;
+            double dl;
+            double dr;
+            double sl;
+            double sr;
+            second(r, i, dl, dr, sl, sr);
+            if (varies_[r.lhs]) {
+                adjoints_[r.lhs] += a * dl;
+                dots_[r.lhs] += da * dl + a * sl;
+            }
+            if (tape::is_binary(r.op) && varies_[r.rhs]) {
+                adjoints_[r.rhs] += a * dr;
+                dots_[r.rhs] += da * dr + a * sr;
+            }
+        }
+
+        for (std::size_t j = 0; j < n_; ++j) {
+            index p = gr.inputs()[j];
+            hv[j] = p != graph::none ? dots_[p] : 0;
+            if (g) g[j] = p != graph::none ? adjoints_[p] : 0;
+        }
+    }
+
+    std::vector<double> product(const std::vector<double>& v) {
+        if (v.size() != n_) {
+            throw std::invalid_argument(
+                "autodiff: direction and inputs differ in size");
+        }
+        std::vector<double> hv(n_);
+        product(v.data(), hv.data());
+        return hv;
+    }
+
+    // The whole matrix row by row, one product per input.
+    std::vector<double> matrix() {
+        std::vector<double> h(n_ * n_);
+        std::vector<double> e(n_, 0.0);
+        for (std::size_t j = 0; j < n_; ++j) {
+            e[j] = 1;
+            product(e.data(), h.data() + j * n_);
+            e[j] = 0;
+        }
+        return h;
+    }
+
+private:
+    using index = graph::index;
+
+    // The partials of record i, as tape::partials() gives them, and their
+    // derivatives along the current tangents.
+    void second(const record& r, std::size_t i, double& dl, double& dr,
+                double& sl, double& sr) const {
+        const double l = graph_[r.lhs].value;
+        const double d = graph_[r.rhs].value;
+        const double tl = tangents_[r.lhs];
+        const double tr = tangents_[r.rhs];
+        tape::partials(r, l, d, dl, dr);
+        sl = 0;
+        sr = 0;
+        switch (r.op) {
+            case opcode::mul:
+                sl = tr;
+                sr = tl;
+                break;
+            case opcode::div:
+                sl = -tr / (d * d);
+                sr = -tl / (d * d) + 2 * l * tr / (d * d * d);
+                break;
+            case opcode::exp:
+                sl = tangents_[i];
+                break;
+            case opcode::sin:
+                sl = -std::sin(l) * tl;
+                break;
+            case opcode::cos:
+                sl = -std::cos(l) * tl;
+                break;
+            case opcode::ln:
+                sl = -tl / (l * l);
+                break;
+            case opcode::log:
+                sl = -tl / (l * l * std::log(2));
+                break;
+            case opcode::pow: {
+                sl = d * (d - 1) * std::pow(l, d - 2) * tl;
+                if (tr != 0) {
+                    sl += tr * std::pow(l, d - 1) * (1 + d * std::log(l));
+                }
+                sr = tangents_[i] * std::log(l) + r.value * tl / l;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    graph graph_;
+    std::size_t n_;
+    std::vector<char> varies_;
+    std::vector<double> tangents_;
+    std::vector<double> adjoints_;
+    std::vector<double> dots_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#include "var.hpp"
+
+namespace autodiff {
+namespace base {
+
+// Keeps the value and the gradient of one recorded function up to date
+// while its inputs change a few at a time. Every record knows the records
+// that consume it, so after set_value() only the cone above the changed
+// inputs is evaluated again, and only the adjoints whose local partials
+// or consumers changed are summed again.
+//
+// Inputs must be changed through set_value() here for the change to be
+// seen, and the records up to head must not be altered otherwise.
+class incremental {
+public:
+    incremental(tape& t, tape::index head)
+        : tape_(&t), output_(head), head_(t.position(head)),
+          offsets_(head_ + 2, 0), changed_(head_ + 1, 0),
+          queued_(head_ + 1, 0) {
+        // consumers in compressed rows: users_[offsets_[i]..offsets_[i+1])
+        for (tape::index c = 0; c <= head_; ++c) {
+            for_operands(c, [&](tape::index j) { ++offsets_[j + 1]; });
+        }
+        for (std::size_t i = 1; i < offsets_.size(); ++i) {
+            offsets_[i] += offsets_[i - 1];
+        }
+        users_.resize(offsets_.back());
+        std::vector<std::size_t> next(offsets_.begin(), offsets_.end() - 1);
+        for (tape::index c = 0; c <= head_; ++c) {
+            for_operands(c, [&](tape::index j) { users_[next[j]++] = c; });
+        }
+        tape_->forward(output_);
+        tape_->backward(output_, adjoints_);
+    }
+
+    explicit incremental(const var& head)
+        : incremental(recorded_on(head), head.get_index()) {}
+
+    double value() const { return (*tape_)[head_].value; }
+
+    // Sets an input and remembers it for the next forward().
+    void set_value(const var& x, double v) {
+        tape::index i = index_of(x);
+        if ((*tape_)[i].value == v) return;
+        // a recorded var reads its value from the tape
+        (*tape_)[i].value = v;
+        mark(i);
+        inputs_.push_back(i);
+    }
+
+    // Re-evaluates the records that depend on inputs changed since the
+    // last call, in tape order, stopping wherever a value comes out the
+    // same as before.
+    double forward() {
+        evaluated_ = 0;
+        std::priority_queue<tape::index, std::vector<tape::index>,
+                            std::greater<tape::index>>
+            work;
+        for (tape::index i : inputs_) enqueue_users(i, work);
+        inputs_.clear();
+        while (!work.empty()) {
+            tape::index i = work.top();
+            work.pop();
+            queued_[i] = 0;
+            record& r = (*tape_)[i];
+            double before = r.value;
+            r.value = tape::apply(r.op, (*tape_)[r.lhs].value,
+                                  (*tape_)[r.rhs].value);
+            ++evaluated_;
+            if (r.value != before) {
+                mark(i);
+                enqueue_users(i, work);
+            }
+        }
+        return value();
+    }
+
+    // d head / d x at the current values. The first query after forward()
+    // re-sums the adjoints of the operands of every record whose partials
+    // moved, and from there only the adjoints that actually changed.
+    double operator[](const var& x) {
+        if (!inputs_.empty()) forward();
+        if (!stale_.empty()) backward();
+        if (x.get_tape() != tape_) return 0;
+        tape::index p = tape_->position(x.get_index());
+        return p <= head_ ? adjoints_[p] : 0;
+    }
+
+    // Records evaluated by the last forward() and adjoints summed by the
+    // last refresh.
+    std::size_t evaluated() const { return evaluated_; }
+    std::size_t propagated() const { return propagated_; }
+
+private:
+    static tape& recorded_on(const var& head) {
+        if (!head.get_tape()) {
+            throw std::logic_error(
+                "autodiff: incremental needs a recorded var");
+        }
+        return *head.get_tape();
+    }
+
+    tape::index index_of(const var& x) const {
+        tape::index p = x.get_tape() == tape_
+                            ? tape_->position(x.get_index())
+                            : head_ + 1;
+        if (p > head_) {
+            throw std::logic_error("autodiff: var is not part of the graph");
+        }
+        return p;
+    }
+
+    // Whether the partials of op depend on the values of its operands.
+    static bool is_linear(opcode op) {
+        return op == opcode::add || op == opcode::sub || op == opcode::neg;
+    }
+
+    template <typename F>
+    void for_operands(tape::index c, F f) const {
+        const record& r = (*tape_)[c];
+        if (r.op == opcode::variable || r.op == opcode::constant) return;
+        f(r.lhs);
+        if (tape::is_binary(r.op) && r.rhs != r.lhs) f(r.rhs);
+    }
+
+    void mark(tape::index i) {
+        if (changed_[i]) return;
+        changed_[i] = 1;
+        stale_.push_back(i);
+    }
+
+    template <typename Queue>
+    void enqueue_users(tape::index i, Queue& work) {
+        for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+            tape::index c = users_[k];
+            if (!queued_[c]) {
+                queued_[c] = 1;
+                work.push(c);
+            }
+        }
+    }
+
+    // d c / d j for an operand j of record c; counts both sides of x * x.
+    double partial(const record& c, tape::index j) const {
+        double dl;
+        double dr;
+        tape::partials(c, (*tape_)[c.lhs].value, (*tape_)[c.rhs].value, dl,
+                       dr);
+        double p = 0;
+        if (c.lhs == j) p += dl;
+        if (c.rhs == j && tape::is_binary(c.op)) p += dr;
+        return p;
+    }
+
+    // Adjoints are pulled rather than pushed: a_j is summed afresh from
+    // the consumers of j, highest index first, so every consumer is final
+    // before any of its operands is summed.
+    void backward() {
+        propagated_ = 0;
+        std::priority_queue<tape::index> work;
+        auto enqueue = [&](tape::index j) {
+            if (!queued_[j]) {
+                queued_[j] = 1;
+                work.push(j);
+            }
+        };
+        for (tape::index i : stale_) {
+            changed_[i] = 0;
+            for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+                tape::index c = users_[k];
+                if (!is_linear((*tape_)[c].op)) for_operands(c, enqueue);
+            }
+        }
+        stale_.clear();
+        while (!work.empty()) {
+            tape::index j = work.top();
+            work.pop();
+            queued_[j] = 0;
+            double a = j == head_ ? 1.0 : 0.0;
+            for (std::size_t k = offsets_[j]; k < offsets_[j + 1]; ++k) {
+                tape::index c = users_[k];
+                if (adjoints_[c] != 0) {
+                    a += adjoints_[c] * partial((*tape_)[c], j);
+                }
+            }
+            ++propagated_;
+            if (a != adjoints_[j]) {
+                adjoints_[j] = a;
+                for_operands(j, enqueue);
+            }
+        }
+    }
+
+    tape* tape_;
+    tape::index output_;
+    tape::index head_;
+    std::vector<std::size_t> offsets_;
+    std::vector<tape::index> users_;
+    std::vector<double> adjoints_;
+    // value changed since the adjoints were last refreshed
+    std::vector<char> changed_;
+    std::vector<char> queued_;
+    std::vector<tape::index> stale_;
+    std::vector<tape::index> inputs_;
+    std::size_t evaluated_ = 0;
+    std::size_t propagated_ = 0;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace autodiff {
+namespace base {
+
+// A sparse matrix in compressed sparse row form: the entries of row i
+// are values[offsets[i] .. offsets[i + 1]), in the columns listed at the
+// same places of columns.
+struct csr {
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> columns;
+    std::vector<double> values;
+};
+
+// d outputs[i] / d inputs[j] for every pair, at the values the graph
+// currently holds. All outputs share one graph, so it is flattened once,
+// and the matrix is filled by whichever costs fewer sweeps: one forward
+// sweep per input or one reverse sweep per output.
+class jacobian {
+public:
+    enum class mode { automatic, forward, reverse };
+
+    jacobian(const std::vector<var>& outputs, const std::vector<var>& inputs,
+             mode m = mode::automatic)
+        : graph_(outputs, inputs),
+          rows_(outputs.size()),
+          cols_(inputs.size()),
+          values_(rows_ * cols_, 0.0) {
+        if (m == mode::automatic) {
+            m = cols_ < rows_ ? mode::forward : mode::reverse;
+        }
+        mode_ = m;
+        if (m == mode::forward) {
+            forward();
+        } else {
+            reverse();
+        }
+    }
+
+    std::size_t rows() const { return rows_; }
+    std::size_t cols() const { return cols_; }
+    mode used() const { return mode_; }
+
+    double operator()(std::size_t i, std::size_t j) const {
+        return values_[i * cols_ + j];
+    }
+
+    // The matrix row by row.
+    const double* data() const { return values_.data(); }
+
+    // Copies the matrix into out, row i starting at out + i * stride.
+    void dense(double* out, std::size_t stride) const {
+        for (std::size_t i = 0; i < rows_; ++i) {
+            for (std::size_t j = 0; j < cols_; ++j) {
+                out[i * stride + j] = values_[i * cols_ + j];
+            }
+        }
+    }
+
+    // The entries that are not zero.
+    csr sparse() const {
+        csr m{rows_, cols_, {0}, {}, {}};
+        for (std::size_t i = 0; i < rows_; ++i) {
+            for (std::size_t j = 0; j < cols_; ++j) {
+                double v = values_[i * cols_ + j];
+                if (v == 0) continue;
+                m.columns.push_back(j);
+                m.values.push_back(v);
+            }
+            m.offsets.push_back(m.values.size());
+        }
+        return m;
+    }
+
+private:
+    using index = graph::index;
+
+    // One tangent sweep per input: the column of d outputs / d x.
+    void forward() {
+        const graph& g = graph_;
+        std::vector<double> dot;
+        for (std::size_t j = 0; j < cols_; ++j) {
+            index p = g.inputs()[j];
+            if (p == graph::none || p >= g.size()) continue;
+            dot.assign(g.size(), 0.0);
+            dot[p] = 1.0;
+            // nothing before p depends on it
+            for (std::size_t i = p + 1; i < g.size(); ++i) {
+                const record& r = g[static_cast<index>(i)];
+                if (r.op == opcode::variable || r.op == opcode::constant) {
+                    continue;
+                }
+                const bool binary = tape::is_binary(r.op);
+                double tl = dot[r.lhs];
+                double tr = binary ? dot[r.rhs] : 0.0;
+                if (tl == 0 && tr == 0) continue;
+                double dl;
+                double dr;
+                tape::partials(r, g[r.lhs].value, g[r.rhs].value, dl, dr);
+                // an operand without a tangent adds nothing, even where
+                // its partial is NaN, e.g. a constant exponent of a
+                // negative base
+                dot[i] = (tl != 0 ? dl * tl : 0.0) + (tr != 0 ? dr * tr : 0.0);
+            }
+            for (std::size_t k = 0; k < rows_; ++k) {
+                values_[k * cols_ + j] = dot[g.outputs()[k]];
+            }
+        }
+    }
+
+    // One adjoint sweep per output: the row of d y / d inputs.
+    void reverse() {
+        const graph& g = graph_;
+        std::vector<double> adjoints;
+        for (std::size_t k = 0; k < rows_; ++k) {
+            index o = g.outputs()[k];
+            tape::backward(&g[0], o, adjoints);
+            for (std::size_t j = 0; j < cols_; ++j) {
+                index p = g.inputs()[j];
+                if (p != graph::none && p <= o) {
+                    values_[k * cols_ + j] = adjoints[p];
+                }
+            }
+        }
+    }
+
+    graph graph_;
+    std::size_t rows_;
+    std::size_t cols_;
+    std::vector<double> values_;
+    mode mode_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "codegen.hpp"
+
+namespace autodiff {
+namespace codegen {
+
+// A compiled value-and-gradient function of one graph together with the
+// constants it was lowered with. It shares the shared object its code
+// lives in, which stays loaded while any kernel from it is alive, even
+// after the jit that built it is gone.
+class kernel {
+public:
+    using function = double (*)(const double* x, const double* c, double* g);
+
+    kernel(function f, std::shared_ptr<void> library,
+           std::vector<double> constants, std::size_t inputs)
+        : f_(f), library_(std::move(library)),
+          constants_(std::move(constants)), inputs_(inputs) {}
+
+    // The value at x, with d value / d x[i] written to g[i].
+    double operator()(const double* x, double* g) const {
+        return f_(x, constants_.data(), g);
+    }
+    double operator()(const std::vector<double>& x,
+                      std::vector<double>& g) const {
+        if (x.size() != inputs_) {
+            throw std::invalid_argument(
+                "autodiff: kernel called with the wrong number of inputs");
+        }
+        g.resize(inputs_);
+        return (*this)(x.data(), g.data());
+    }
+
+    std::size_t inputs() const { return inputs_; }
+
+private:
+    function f_;
+    std::shared_ptr<void> library_;
+    std::vector<double> constants_;
+    std::size_t inputs_;
+};
+
+// Compiles graphs to native code at runtime with the C++ compiler on the
+// machine. Code is emitted with the constants left as arguments, so the
+// compiled kernels are cached by the structure of the graph alone: a
+// graph rebuilt with the same operations, whatever its constants, is
+// compiled once per jit. Shared objects are also kept in `directory`
+// under a name derived from their source, where later processes find
+// them. Since whatever is loaded from there runs in this process, the
+// directory and every shared object in it must belong to the user and be
+// writable by nobody else; the default is a directory of the user's own
+// under the system's temporary one, created with mode 0700.
+//
+// The compiler is taken from AUTODIFF_JIT_CXX, or `c++`. POSIX only.
+class jit {
+public:
+    explicit jit(std::filesystem::path directory = user_directory())
+        : directory_(std::move(directory)) {
+        const char* cxx = std::getenv("AUTODIFF_JIT_CXX");
+        compiler_ = cxx && *cxx ? cxx : "c++";
+        if (directory_.has_parent_path()) {
+            std::filesystem::create_directories(directory_.parent_path());
+        }
+        if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+            throw std::runtime_error("autodiff: jit: cannot create " +
+                                     directory_.string());
+        }
+        if (!owned(directory_, S_IFDIR)) {
+            throw std::runtime_error(
+                "autodiff: jit: " + directory_.string() +
+                " is not a directory of this user's that only it can write");
+        }
+    }
+
+    static std::filesystem::path user_directory() {
+        return std::filesystem::temp_directory_path() /
+               ("autodiff-jit-" + std::to_string(geteuid()));
+    }
+
+    jit(const jit&) = delete;
+    jit& operator=(const jit&) = delete;
+
+    // The compiler command, e.g. "clang++".
+    void set_compiler(std::string compiler) { compiler_ = std::move(compiler); }
+
+    // A kernel for y and its gradient with respect to inputs.
+    kernel compile(var& y, const std::vector<var>& inputs) {
+        program p = lower(y, inputs);
+        std::string source = emit(p, "autodiff_kernel", false);
+        entry e = load(source);
+        return kernel(e.f, e.library, constants(p), inputs.size());
+    }
+
+    // Kernels loaded so far, and how many of them had to be compiled.
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.size();
+    }
+    std::size_t compilations() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compilations_;
+    }
+
+private:
+    struct entry {
+        std::shared_ptr<void> library;
+        kernel::function f;
+    };
+
+    // Whether path is of the given type, belongs to this user and is
+    // writable by nobody else.
+    static bool owned(const std::filesystem::path& path, mode_t type) {
+        struct stat st;
+        return lstat(path.c_str(), &st) == 0 &&
+               (st.st_mode & S_IFMT) == type && st.st_uid == geteuid() &&
+               (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+    }
+
+    entry load(const std::string& source) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = cache_.find(source);
+        if (found != cache_.end()) return found->second;
+
+        std::ostringstream stem;
+        stem << std::hex << std::hash<std::string>()(source);
+        auto cpp = directory_ / (stem.str() + ".cpp");
+        auto so = directory_ / (stem.str() + ".so");
+        if (!std::filesystem::exists(so) || read(cpp) != source) {
+            build(source, cpp, so);
+        }
+
+        if (!owned(so, S_IFREG)) {
+            throw std::runtime_error("autodiff: jit: refusing to load " +
+                                     so.string() +
+                                     ", which others could have written");
+        }
+
+        void* handle = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            throw std::runtime_error(std::string("autodiff: jit: ") +
+                                     dlerror());
+        }
+        std::shared_ptr<void> library(handle, dlclose);
+        auto f = reinterpret_cast<kernel::function>(
+            dlsym(handle, "autodiff_kernel"));
+        if (!f) {
+            throw std::runtime_error("autodiff: jit: kernel not found in " +
+                                     so.string());
+        }
+        entry e{std::move(library), f};
+        cache_.emplace(source, e);
+        return e;
+    }
+
+    // Compiles to private names first and renames into place, so that
+    // processes sharing the directory never see a partial file.
+    void build(const std::string& source, const std::filesystem::path& cpp,
+               const std::filesystem::path& so) {
+        std::string suffix = "." + std::to_string(getpid());
+        auto tmp_cpp = cpp.string() + suffix + ".cpp";
+        auto tmp_so = so.string() + suffix;
+        auto log = so.string() + suffix + ".log";
+        {
+            std::ofstream out(tmp_cpp);
+            out << source;
+            if (!out) {
+                throw std::runtime_error("autodiff: jit: cannot write " +
+                                         tmp_cpp);
+            }
+        }
+        std::string command = compiler_ +
+                              " -O2 -fPIC -shared -o \"" + tmp_so + "\" \"" +
+                              tmp_cpp + "\" > \"" + log + "\" 2>&1";
+        int status = std::system(command.c_str());
+        if (status != 0) {
+            std::string message = read(log);
+            std::filesystem::remove(tmp_cpp);
+            std::filesystem::remove(tmp_so);
+            std::filesystem::remove(log);
+            throw std::runtime_error("autodiff: jit: `" + command +
+                                     "` failed\n" + message);
+        }
+        std::filesystem::remove(log);
+        std::filesystem::rename(tmp_so, so);
+        std::filesystem::rename(tmp_cpp, cpp);
+        ++compilations_;
+    }
+
+    static std::string read(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+    std::filesystem::path directory_;
+    std::string compiler_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, entry> cache_;
+    std::size_t compilations_ = 0;
+};
+
+}  // namespace codegen
+}  // namespace autodiff
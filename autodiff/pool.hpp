@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace autodiff {
+namespace base {
+
+// A fixed set of workers that share out the tasks of one parallel_for()
+// at a time. Every worker owns a queue seeded with a contiguous block of
+// the tasks; it takes work from the back of its own queue and, once that
+// runs dry, steals from the front of the others, so uneven tasks still
+// keep every worker busy.
+//
+// The calling thread is worker 0, so a pool of size n starts n - 1
+// threads and a pool of size 1 runs everything inline. Tasks must not
+// call parallel_for() on the pool they run on.
+class thread_pool {
+public:
+    explicit thread_pool(
+        std::size_t size = std::thread::hardware_concurrency())
+        : queues_(size ? size : 1) {
+        for (std::size_t w = 1; w < queues_.size(); ++w) {
+            threads_.emplace_back([this, w] { work(w); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    std::size_t size() const { return queues_.size(); }
+
+    // Calls f(task, worker) for every task in [0, tasks) and returns once
+    // all of them are done. worker < size() identifies the thread, so f
+    // can keep per-worker scratch space. The first exception thrown by a
+    // task is rethrown here after the remaining tasks have run.
+    void parallel_for(std::size_t tasks,
+                      std::function<void(std::size_t, std::size_t)> f) {
+        if (tasks == 0) return;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return busy_ == 0; });
+            job_ = std::move(f);
+            error_ = nullptr;
+            pending_ = tasks;
+            std::size_t n = queues_.size();
+            for (std::size_t w = 0; w < n; ++w) {
+                std::lock_guard<std::mutex> q(queues_[w].mutex);
+                for (std::size_t t = tasks * w / n; t < tasks * (w + 1) / n;
+                     ++t) {
+                    queues_[w].tasks.push_back(t);
+                }
+            }
+            ++generation_;
+        }
+        wake_.notify_all();
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0 && busy_ == 0; });
+        job_ = nullptr;
+        if (error_) std::rethrow_exception(error_);
+    }
+
+private:
+    struct queue {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    void work(std::size_t w) {
+        std::uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock,
+                           [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                ++busy_;
+            }
+            drain(w);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --busy_;
+            }
+            idle_.notify_all();
+        }
+    }
+
+    void drain(std::size_t w) {
+        std::size_t task;
+        while (take(w, task)) {
+            try {
+                job_(task, w);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) error_ = std::current_exception();
+            }
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idle_.notify_all();
+            }
+        }
+    }
+
+    bool take(std::size_t w, std::size_t& task) {
+        {
+            queue& own = queues_[w];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < queues_.size(); ++i) {
+            queue& victim = queues_[(w + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<queue> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::function<void(std::size_t, std::size_t)> job_;
+    std::exception_ptr error_;
+    std::atomic<std::size_t> pending_{0};
+    std::size_t busy_ = 0;
+    std::uint64_t generation_ = 0;
+    bool stop_ = false;
+};
+
+}  // namespace base
+}  // namespace autodiff
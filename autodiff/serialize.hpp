@@ -0,0 +1,270 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "var.hpp"
+
+namespace autodiff {
+namespace base {
+
+// The binary form of a recorded graph. Everything is stored in the
+// byte order and layout of the machine that wrote it, which the header
+// records, so that a file can be mapped and evaluated where it lies:
+//
+//   header
+//   records    header.records x record, at offset sizeof(header)
+//   indices    header.indices x tape::index
+//   outputs    header.outputs x tape::index, padded to 8 bytes
+//   names      header.names x {index, length}, then the characters
+//
+// Indices are those the vars held when the file was written; outputs
+// and names refer to them, and records refer to each other by position,
+// as on the tape.
+namespace format {
+
+constexpr char magic[8] = {'a', 'u', 't', 'o', 'd', 'i', 'f', 'f'};
+constexpr std::uint32_t version = 1;
+constexpr std::uint32_t order = 0x01020304;
+// the index of a record that simplify() removed
+constexpr tape::index removed = static_cast<tape::index>(-1);
+
+struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t order;
+    std::uint32_t record_size;
+    std::uint32_t index_size;
+    std::uint64_t records;
+    std::uint64_t indices;
+    std::uint64_t outputs;
+    std::uint64_t names;
+    std::uint64_t name_bytes;
+    std::uint64_t reserved;
+};
+
+struct name {
+    tape::index index;
+    std::uint32_t length;
+};
+
+inline std::size_t padded(std::size_t n) { return (n + 7) / 8 * 8; }
+
+}  // namespace format
+
+// Writes the tape of the outputs to path, with the leaves under the
+// names they were created with, e.g. var(std::string("x"), 1.0).
+inline void save(const std::string& path, const std::vector<var>& outputs,
+                 const std::vector<var>& leaves = {}) {
+    if (outputs.empty() || !outputs[0].get_tape()) {
+        throw std::logic_error("autodiff: save needs recorded outputs");
+    }
+    tape& t = *outputs[0].get_tape();
+    for (const auto& v : outputs) {
+        if (v.get_tape() != &t) {
+            throw std::logic_error("autodiff: outputs live on different tapes");
+        }
+    }
+    for (const auto& v : leaves) {
+        if (v.get_tape() != &t) {
+            throw std::logic_error("autodiff: var is not part of the graph");
+        }
+    }
+    // only once they are known to index t: throws if simplify() dropped one
+    for (const auto& v : outputs) t.position(v.get_index());
+    for (const auto& v : leaves) t.position(v.get_index());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::size_t name_bytes = 0;
+    for (const auto& v : leaves) name_bytes += v.to_string().size();
+    format::header h{};
+    std::memcpy(h.magic, format::magic, sizeof h.magic);
+    h.version = format::version;
+    h.order = format::order;
+    h.record_size = sizeof(record);
+    h.index_size = sizeof(tape::index);
+    h.records = t.size();
+    h.indices = t.indices();
+    h.outputs = outputs.size();
+    h.names = leaves.size();
+    h.name_bytes = name_bytes;
+    out.write(reinterpret_cast<const char*>(&h), sizeof h);
+
+    // copied field by field so that padding is written as zeros
+    std::vector<record> chunk;
+    chunk.reserve(4096);
+    auto flush = [&] {
+        out.write(reinterpret_cast<const char*>(chunk.data()),
+                  chunk.size() * sizeof(record));
+        chunk.clear();
+    };
+    for (std::size_t p = 0; p < t.size(); ++p) {
+        chunk.emplace_back();
+        std::memset(&chunk.back(), 0, sizeof(record));
+        const record& r = t[static_cast<tape::index>(p)];
+        chunk.back().op = r.op;
+        chunk.back().lhs = r.lhs;
+        chunk.back().rhs = r.rhs;
+        chunk.back().value = r.value;
+        if (chunk.size() == 4096) flush();
+    }
+    flush();
+
+    std::vector<tape::index> indices(t.indices(), format::removed);
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        auto k = static_cast<tape::index>(i);
+        if (!t.removed(k)) indices[i] = t.position(k);
+    }
+    for (const auto& v : outputs) indices.push_back(v.get_index());
+    indices.resize(format::padded(indices.size() * sizeof(tape::index)) /
+                   sizeof(tape::index));
+    out.write(reinterpret_cast<const char*>(indices.data()),
+              indices.size() * sizeof(tape::index));
+
+    for (const auto& v : leaves) {
+        format::name n{v.get_index(),
+                       static_cast<std::uint32_t>(v.to_string().size())};
+        out.write(reinterpret_cast<const char*>(&n), sizeof n);
+    }
+    for (const auto& v : leaves) out << v.to_string();
+    if (!out) throw std::runtime_error("autodiff: cannot write " + path);
+}
+
+// A graph mapped from a file written by save(). Its tape evaluates the
+// records in place: nothing is parsed or copied up front, and pages are
+// read in as passes reach them. Values computed on the tape go to
+// private copies of those pages and never back to the file.
+//
+// Load a file from an untrusted source with verify set, which checks
+// every record once before the tape is used.
+class image {
+public:
+    explicit image(const std::string& path, bool verify = false) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("autodiff: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 ||
+            static_cast<std::size_t>(st.st_size) < sizeof(format::header)) {
+            ::close(fd);
+            throw std::runtime_error("autodiff: " + path +
+                                     " is not a graph file");
+        }
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("autodiff: cannot map " + path);
+        }
+        std::shared_ptr<void> mapping(
+            base, [size](void* p) { ::munmap(p, size); });
+
+        auto* bytes = static_cast<char*>(base);
+        const auto* h = reinterpret_cast<const format::header*>(bytes);
+        check(std::memcmp(h->magic, format::magic, sizeof h->magic) == 0,
+              path, "is not a graph file");
+        check(h->version == format::version, path,
+              "has an unsupported version");
+        check(h->order == format::order &&
+                  h->record_size == sizeof(record) &&
+                  h->index_size == sizeof(tape::index),
+              path, "was written on a different kind of machine");
+        std::size_t offset = sizeof(format::header);
+        std::size_t index_bytes =
+            format::padded((h->indices + h->outputs) * sizeof(tape::index));
+        std::size_t expected =
+            offset + h->records * sizeof(record) + index_bytes +
+            h->names * sizeof(format::name) + h->name_bytes;
+        check(h->records < format::removed && h->indices < format::removed &&
+                  h->outputs < size && h->names < size &&
+                  h->name_bytes < size && expected == size,
+              path, "is truncated or corrupt");
+
+        auto* records = reinterpret_cast<record*>(bytes + offset);
+        offset += h->records * sizeof(record);
+        auto* indices = reinterpret_cast<tape::index*>(bytes + offset);
+        offset += index_bytes;
+        outputs_.assign(indices + h->indices,
+                        indices + h->indices + h->outputs);
+        const auto* names = reinterpret_cast<const format::name*>(
+            bytes + offset);
+        const char* chars = bytes + offset + h->names * sizeof(format::name);
+        for (std::size_t k = 0; k < h->names; ++k) {
+            check(names[k].length <=
+                      static_cast<std::size_t>(bytes + size - chars),
+                  path,
+                  "is truncated or corrupt");
+            names_.emplace(std::string(chars, names[k].length),
+                           names[k].index);
+            chars += names[k].length;
+        }
+        auto known = [&](tape::index i) {
+            return i < h->indices && indices[i] < h->records;
+        };
+        for (tape::index o : outputs_) check(known(o), path, "is corrupt");
+        for (const auto& n : names_) check(known(n.second), path, "is corrupt");
+        if (verify) {
+            check(valid(records, h->records, indices, h->indices), path,
+                  "is corrupt");
+        }
+        tape_.adopt(records, h->records, indices, h->indices,
+                    std::move(mapping));
+    }
+
+    image(const image&) = delete;
+    image& operator=(const image&) = delete;
+
+    tape& get_tape() { return tape_; }
+
+    std::size_t outputs() const { return outputs_.size(); }
+    var output(std::size_t k) { return var::on(tape_, outputs_.at(k)); }
+
+    // The leaf saved under name.
+    var leaf(const std::string& name) {
+        auto n = names_.find(name);
+        if (n == names_.end()) {
+            throw std::out_of_range("autodiff: no leaf named " + name);
+        }
+        return var::on(tape_, n->second);
+    }
+
+private:
+    static void check(bool ok, const std::string& path, const char* what) {
+        if (!ok) throw std::runtime_error("autodiff: " + path + " " + what);
+    }
+
+    // Whether every index and operand refers to an earlier record and
+    // every opcode is one the passes know.
+    static bool valid(const record* records, std::size_t n,
+                      const tape::index* indices, std::size_t m) {
+        for (std::size_t i = 0; i < m; ++i) {
+            if (indices[i] >= n && indices[i] != format::removed) return false;
+        }
+        for (std::size_t p = 0; p < n; ++p) {
+            const record& r = records[p];
+            if (r.op > opcode::pow) return false;
+            if (r.op == opcode::variable || r.op == opcode::constant) continue;
+            if (r.lhs >= p || r.rhs >= p) return false;
+        }
+        return true;
+    }
+
+    tape tape_;
+    std::vector<tape::index> outputs_;
+    std::unordered_map<std::string, tape::index> names_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "hessian.hpp"
+#include "jacobian.hpp"
+
+namespace autodiff {
+namespace base {
+
+// A sparse matrix in compressed sparse column form: the entries of
+// column j are values[offsets[j] .. offsets[j + 1]), in the rows listed
+// at the same places of rows.
+struct csc {
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> rows_of;
+    std::vector<double> values;
+};
+
+inline csc to_csc(const csr& m) {
+    csc c{m.rows, m.cols, std::vector<std::size_t>(m.cols + 1, 0), {}, {}};
+    for (std::size_t j : m.columns) ++c.offsets[j + 1];
+    for (std::size_t j = 0; j < m.cols; ++j) c.offsets[j + 1] += c.offsets[j];
+    c.rows_of.resize(m.columns.size());
+    c.values.resize(m.values.size());
+    std::vector<std::size_t> next(c.offsets.begin(), c.offsets.end() - 1);
+    for (std::size_t i = 0; i < m.rows; ++i) {
+        for (std::size_t k = m.offsets[i]; k < m.offsets[i + 1]; ++k) {
+            std::size_t at = next[m.columns[k]]++;
+            c.rows_of[at] = i;
+            if (!m.values.empty()) c.values[at] = m.values[k];
+        }
+    }
+    return c;
+}
+
+namespace sparsity {
+
+using set = std::vector<std::size_t>;
+
+inline void merge(set& into, const set& from) {
+    if (from.empty()) return;
+    set out;
+    out.reserve(into.size() + from.size());
+    std::set_union(into.begin(), into.end(), from.begin(), from.end(),
+                   std::back_inserter(out));
+    into.swap(out);
+}
+
+// For every record of g, the inputs it depends on.
+inline std::vector<set> dependencies(const graph& g) {
+    std::vector<set> deps(g.size());
+    for (std::size_t j = 0; j < g.inputs().size(); ++j) {
+        graph::index p = g.inputs()[j];
+        if (p != graph::none && p < g.size()) deps[p].push_back(j);
+    }
+    for (std::size_t i = 0; i < g.size(); ++i) {
+        const record& r = g[static_cast<graph::index>(i)];
+        if (r.op == opcode::variable || r.op == opcode::constant) continue;
+        merge(deps[i], deps[r.lhs]);
+        if (tape::is_binary(r.op)) merge(deps[i], deps[r.rhs]);
+    }
+    return deps;
+}
+
+// The pattern of a matrix whose row i has the entries in rows[i].
+inline csr pattern(const std::vector<set>& rows, std::size_t cols) {
+    csr m{rows.size(), cols, {0}, {}, {}};
+    for (const set& s : rows) {
+        m.columns.insert(m.columns.end(), s.begin(), s.end());
+        m.offsets.push_back(m.columns.size());
+    }
+    return m;
+}
+
+// Greedy colouring of the columns of m such that no row has two entries
+// of one colour; returns the colour of every column.
+inline std::vector<std::size_t> colour_columns(const csr& m,
+                                               std::size_t& colours) {
+    csc c = to_csc(m);
+    std::vector<std::size_t> colour(m.cols, 0);
+    std::vector<std::size_t> seen;
+    colours = 0;
+    for (std::size_t j = 0; j < m.cols; ++j) {
+        seen.assign(colours + 1, m.cols);
+        for (std::size_t k = c.offsets[j]; k < c.offsets[j + 1]; ++k) {
+            std::size_t i = c.rows_of[k];
+            for (std::size_t e = m.offsets[i]; e < m.offsets[i + 1]; ++e) {
+                std::size_t o = m.columns[e];
+                if (o < j) seen[colour[o]] = j;
+            }
+        }
+        std::size_t pick = 0;
+        while (pick < colours && seen[pick] == j) ++pick;
+        colour[j] = pick;
+        if (pick == colours) ++colours;
+    }
+    return colour;
+}
+
+// The transpose of the pattern m.
+inline csr transpose(const csr& m) {
+    csc c = to_csc(m);
+    return csr{m.cols, m.rows, c.offsets, c.rows_of, {}};
+}
+
+}  // namespace sparsity
+
+// A Jacobian whose outputs each depend on a few inputs. Its pattern is
+// found once by carrying the set of inputs every record depends on
+// through the graph. Columns that share no row are then given one
+// colour and seeded together, so a forward sweep per colour recovers
+// them all; or rows are coloured likewise and swept in reverse, if that
+// takes fewer sweeps. evaluate() repeats only the sweeps.
+class sparse_jacobian {
+public:
+    sparse_jacobian(const std::vector<var>& outputs,
+                    const std::vector<var>& inputs)
+        : graph_(outputs, inputs) {
+        auto deps = sparsity::dependencies(graph_);
+        std::vector<sparsity::set> rows;
+        for (graph::index o : graph_.outputs()) rows.push_back(deps[o]);
+        matrix_ = sparsity::pattern(rows, inputs.size());
+        std::size_t by_column;
+        std::size_t by_row;
+        auto columns = sparsity::colour_columns(matrix_, by_column);
+        auto transposed = sparsity::transpose(matrix_);
+        auto rows_colour = sparsity::colour_columns(transposed, by_row);
+        forward_ = by_column <= by_row;
+        colours_ = forward_ ? by_column : by_row;
+        colour_ = forward_ ? std::move(columns) : std::move(rows_colour);
+        evaluate();
+    }
+
+    // Sweeps a colour's worth of the matrix at a time.
+    std::size_t colours() const { return colours_; }
+    bool forward() const { return forward_; }
+
+    // Recomputes the entries at the values the graph currently holds.
+    void evaluate() {
+        matrix_.values.assign(matrix_.columns.size(), 0.0);
+        if (forward_) {
+            tangents();
+        } else {
+            adjoints();
+        }
+    }
+
+    const csr& matrix() const { return matrix_; }
+    csc columns() const { return to_csc(matrix_); }
+
+private:
+    using index = graph::index;
+
+    void tangents() {
+        const graph& g = graph_;
+        std::vector<double> dot;
+        for (std::size_t c = 0; c < colours_; ++c) {
+            dot.assign(g.size(), 0.0);
+            for (std::size_t j = 0; j < colour_.size(); ++j) {
+                index p = g.inputs()[j];
+                if (colour_[j] == c && p != graph::none && p < g.size()) {
+                    dot[p] = 1.0;
+                }
+            }
+            for (std::size_t i = 0; i < g.size(); ++i) {
+                const record& r = g[static_cast<index>(i)];
+                if (r.op == opcode::variable || r.op == opcode::constant) {
+                    continue;
+                }
+                const bool binary = tape::is_binary(r.op);
+                double tl = dot[r.lhs];
+                double tr = binary ? dot[r.rhs] : 0.0;
+                if (tl == 0 && tr == 0) continue;
+                double dl;
+                double dr;
+                tape::partials(r, g[r.lhs].value, g[r.rhs].value, dl, dr);
+                // as in jacobian::forward, skip an operand without a
+                // tangent so a NaN partial can't leak in
+                dot[i] = (tl != 0 ? dl * tl : 0.0) + (tr != 0 ? dr * tr : 0.0);
+            }
+            for (std::size_t i = 0; i < matrix_.rows; ++i) {
+                for (std::size_t k = matrix_.offsets[i];
+                     k < matrix_.offsets[i + 1]; ++k) {
+                    if (colour_[matrix_.columns[k]] == c) {
+                        matrix_.values[k] = dot[g.outputs()[i]];
+                    }
+                }
+            }
+        }
+    }
+
+    void adjoints() {
+        const graph& g = graph_;
+        std::vector<double> adj;
+        for (std::size_t c = 0; c < colours_; ++c) {
+            adj.assign(g.size(), 0.0);
+            for (std::size_t i = 0; i < matrix_.rows; ++i) {
+                if (colour_[i] == c) adj[g.outputs()[i]] += 1.0;
+            }
+            for (std::size_t i = g.size(); i-- > 0;) {
+                const double a = adj[i];
+                if (a == 0.0) continue;
+                const record& r = g[static_cast<index>(i)];
+                if (r.op == opcode::variable || r.op == opcode::constant) {
+                    continue;
+                }
+                double dl;
+                double dr;
+                tape::partials(r, g[r.lhs].value, g[r.rhs].value, dl, dr);
+                adj[r.lhs] += a * dl;
+                if (tape::is_binary(r.op)) adj[r.rhs] += a * dr;
+            }
+            for (std::size_t i = 0; i < matrix_.rows; ++i) {
+                if (colour_[i] != c) continue;
+                for (std::size_t k = matrix_.offsets[i];
+                     k < matrix_.offsets[i + 1]; ++k) {
+                    matrix_.values[k] = adj[g.inputs()[matrix_.columns[k]]];
+                }
+            }
+        }
+    }
+
+    graph graph_;
+    csr matrix_;
+    std::vector<std::size_t> colour_;
+    std::size_t colours_ = 0;
+    bool forward_ = true;
+};
+
+// A Hessian with few entries per row. Its pattern is found from the
+// dependency sets: every nonlinear record that y depends on makes the
+// inputs of its operands interact. Columns that share no row are
+// coloured alike, and one Hessian-vector product per colour recovers
+// them all.
+class sparse_hessian {
+public:
+    sparse_hessian(const var& y, const std::vector<var>& inputs)
+        : hessian_(y, inputs), n_(inputs.size()) {
+        const graph& g = hessian_.get_graph();
+        auto deps = sparsity::dependencies(g);
+        // records whose adjoint can be nonzero
+        std::vector<char> live(g.size(), 0);
+        live[g.size() - 1] = 1;
+        std::vector<sparsity::set> rows(n_);
+        auto interact = [&](const sparsity::set& a, const sparsity::set& b) {
+            for (std::size_t i : a) sparsity::merge(rows[i], b);
+            for (std::size_t i : b) sparsity::merge(rows[i], a);
+        };
+        for (std::size_t i = g.size(); i-- > 0;) {
+            const record& r = g[static_cast<graph::index>(i)];
+            if (!live[i] || r.op == opcode::variable ||
+                r.op == opcode::constant) {
+                continue;
+            }
+            live[r.lhs] = 1;
+            if (tape::is_binary(r.op)) live[r.rhs] = 1;
+            const sparsity::set& l = deps[r.lhs];
+            const sparsity::set& d = deps[r.rhs];
+            switch (r.op) {
+                case opcode::add:
+                case opcode::sub:
+                case opcode::neg:
+                    break;
+                case opcode::mul:
+                    interact(l, d);
+                    break;
+                case opcode::div:
+                    interact(l, d);
+                    interact(d, d);
+                    break;
+                case opcode::pow: {
+                    sparsity::set both = l;
+                    sparsity::merge(both, d);
+                    interact(both, both);
+                    break;
+                }
+                default:
+                    interact(l, l);
+                    break;
+            }
+        }
+        matrix_ = sparsity::pattern(rows, n_);
+        colour_ = sparsity::colour_columns(matrix_, colours_);
+        evaluate();
+    }
+
+    std::size_t colours() const { return colours_; }
+
+    // Recomputes the entries at the values the graph currently holds.
+    void evaluate() {
+        matrix_.values.assign(matrix_.columns.size(), 0.0);
+        std::vector<double> seed(n_);
+        std::vector<double> hv(n_);
+        for (std::size_t c = 0; c < colours_; ++c) {
+            for (std::size_t j = 0; j < n_; ++j) seed[j] = colour_[j] == c;
+            hessian_.product(seed.data(), hv.data());
+            for (std::size_t i = 0; i < n_; ++i) {
+                for (std::size_t k = matrix_.offsets[i];
+                     k < matrix_.offsets[i + 1]; ++k) {
+                    if (colour_[matrix_.columns[k]] == c) {
+                        matrix_.values[k] = hv[i];
+                    }
+                }
+            }
+        }
+    }
+
+    const csr& matrix() const { return matrix_; }
+    csc columns() const { return to_csc(matrix_); }
+
+private:
+    hessian hessian_;
+    std::size_t n_;
+    csr matrix_;
+    std::vector<std::size_t> colour_;
+    std::size_t colours_ = 0;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,556 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "cse.hpp"
+#include "token.hpp"
+
+namespace autodiff {
+namespace base {
+
+// One entry of the Wengert list. Operands always refer to earlier
+// records, so the list is already in topological order.
+struct record {
+    opcode op;
+    std::uint32_t lhs;
+    std::uint32_t rhs;
+    double value;
+};
+
+// A growable array that can also be a view of memory it does not own,
+// such as a mapped file. Elements of a view are written in place; the
+// first change of size copies them into memory of its own.
+template <typename T>
+class storage {
+public:
+    std::size_t size() const { return size_; }
+    T& operator[](std::size_t i) { return data_[i]; }
+    const T& operator[](std::size_t i) const { return data_[i]; }
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+
+    void push_back(const T& v) {
+        if (owner_) own();
+        owned_.push_back(v);
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+    void reserve(std::size_t n) {
+        if (owner_) own();
+        owned_.reserve(n);
+        data_ = owned_.data();
+    }
+    void clear() {
+        owner_.reset();
+        owned_.clear();
+        data_ = owned_.data();
+        size_ = 0;
+    }
+
+    // Uses the n elements at data, which owner keeps alive.
+    void view(T* data, std::size_t n, std::shared_ptr<void> owner) {
+        owned_ = std::vector<T>();
+        data_ = data;
+        size_ = n;
+        owner_ = std::move(owner);
+    }
+
+private:
+    void own() {
+        owned_.assign(data_, data_ + size_);
+        owner_.reset();
+        data_ = owned_.data();
+    }
+
+    std::vector<T> owned_;
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::shared_ptr<void> owner_;
+};
+
+// A contiguous tape of operations. While a tape is recording, every
+// var operation appends a record here instead of allocating tree nodes,
+// and gradients are computed by one reverse sweep over the array.
+//
+// Vars refer to their record through an index that the tape maps to the
+// record's position. The two agree until simplify() rewrites the tape,
+// after which every index still finds the record now standing for it.
+// Record operands and adjoint buffers always use positions.
+//
+// A tape owns all of its recording state and the active tape is tracked
+// per thread, so threads recording onto their own tapes never share
+// anything mutable.
+class tape {
+public:
+    using index = std::uint32_t;
+
+    // Makes a tape the active one on this thread for its lifetime and
+    // restores the previously active tape afterwards.
+    class recording {
+    public:
+        explicit recording(tape& t) : previous_(slot()) { slot() = &t; }
+        ~recording() { slot() = previous_; }
+
+        recording(const recording&) = delete;
+        recording& operator=(const recording&) = delete;
+
+    private:
+        tape* previous_;
+    };
+
+    tape() = default;
+    tape(const tape&) = delete;
+    tape& operator=(const tape&) = delete;
+
+    static tape* active() { return slot(); }
+
+    // Appends op over the records of lhs and rhs and returns its index.
+    index push(opcode op, index lhs, index rhs, double value) {
+        if (slots_.size() >= dropped) {
+            throw std::length_error("autodiff: tape is full");
+        }
+        if (op != opcode::variable && op != opcode::constant) {
+            lhs = slots_[lhs];
+            rhs = is_binary(op) ? slots_[rhs] : lhs;
+        }
+        if (sharing_ && op != opcode::variable) {
+            shape s = key(record{op, lhs, rhs, value});
+            auto found = shapes_.find(s);
+            if (found != shapes_.end()) {
+                slots_.push_back(found->second);
+                return static_cast<index>(slots_.size() - 1);
+            }
+            shapes_.emplace(s, static_cast<index>(records_.size()));
+        }
+        slots_.push_back(static_cast<index>(records_.size()));
+        records_.push_back(record{op, lhs, rhs, value});
+        return static_cast<index>(slots_.size() - 1);
+    }
+
+    // Turns hash-consing on or off. While it is on, an operation or
+    // constant identical to one already on the tape is not recorded
+    // again; its index refers to the existing record instead.
+    void share(bool on = true) {
+        sharing_ = on;
+        shapes_.clear();
+        if (on) index_shapes();
+    }
+    bool sharing() const { return sharing_; }
+
+    index push_variable(double value) {
+        return push(opcode::variable, 0, 0, value);
+    }
+
+    index push_constant(double value) {
+        return push(opcode::constant, 0, 0, value);
+    }
+
+    // The position of the record that index i refers to.
+    index position(index i) const {
+        index p = slots_[i];
+        if (p == dropped) {
+            throw std::logic_error("autodiff: var was removed by simplify");
+        }
+        return p;
+    }
+
+    // Whether simplify() removed the record index i referred to.
+    bool removed(index i) const { return slots_[i] == dropped; }
+
+    double value(index i) const { return records_[position(i)].value; }
+
+    // Records by position.
+    record& operator[](index p) { return records_[p]; }
+    const record& operator[](index p) const { return records_[p]; }
+
+    std::size_t size() const { return records_.size(); }
+    // Indices handed out so far, whether or not simplify() kept them.
+    std::size_t indices() const { return slots_.size(); }
+
+    // Replaces the contents of the tape with n records and m indices in
+    // memory it does not own, e.g. a mapped file, which owner keeps
+    // alive. Evaluating the tape writes values into that memory.
+    void adopt(record* records, std::size_t n, index* slots, std::size_t m,
+               std::shared_ptr<void> owner) {
+        records_.view(records, n, owner);
+        slots_.view(slots, m, std::move(owner));
+        shapes_.clear();
+        if (sharing_) index_shapes();
+    }
+    void reserve(std::size_t n) {
+        records_.reserve(n);
+        slots_.reserve(n);
+    }
+    void clear() {
+        records_.clear();
+        slots_.clear();
+        shapes_.clear();
+    }
+
+    // The value of op applied to l (and r).
+    static double apply(opcode op, double l, double r) {
+        switch (op) {
+            case opcode::add:
+                return l + r;
+            case opcode::sub:
+                return l - r;
+            case opcode::mul:
+                return l * r;
+            case opcode::div:
+                return l / r;
+            case opcode::neg:
+                return -l;
+            case opcode::exp:
+                return std::exp(l);
+            case opcode::sin:
+                return std::sin(l);
+            case opcode::cos:
+                return std::cos(l);
+            case opcode::ln:
+                return std::log(l);
+            case opcode::log:
+                return std::log(l) / std::log(2);
+            case opcode::pow:
+                return std::pow(l, r);
+            default:
+                return l;
+        }
+    }
+
+    // The partials of r with respect to its left and right operand, whose
+    // values are l and d; the right one is meaningful for binary ops only.
+    static void partials(const record& r, double l, double d, double& dl,
+                         double& dr) {
+        dr = 0;
+        switch (r.op) {
+            case opcode::add: dl = 1; dr = 1; break;
+            case opcode::sub: dl = 1; dr = -1; break;
+            case opcode::mul: dl = d; dr = l; break;
+            case opcode::div: dl = 1 / d; dr = -l / (d * d); break;
+            case opcode::neg: dl = -1; break;
+            case opcode::exp: dl = r.value; break;
+            case opcode::sin: dl = std::cos(l); break;
+            case opcode::cos: dl = -std::sin(l); break;
+            case opcode::ln: dl = 1 / l; break;
+            case opcode::log: dl = 1 / (l * std::log(2)); break;
+            case opcode::pow:
+                dl = d * std::pow(l, d - 1);
+                dr = r.value * std::log(l);
+                break;
+            default: dl = 0; break;
+        }
+    }
+
+    // Whether op reads its right operand.
+    static bool is_binary(opcode op) {
+        switch (op) {
+            case opcode::add:
+            case opcode::sub:
+            case opcode::mul:
+            case opcode::div:
+            case opcode::pow:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Recomputes the values of all records up to and including head.
+    double forward(index head) {
+        const index end = position(head);
+        for (index i = 0; i <= end; ++i) {
+            record& r = records_[i];
+            if (r.op == opcode::variable || r.op == opcode::constant) continue;
+            r.value = apply(r.op, records_[r.lhs].value, records_[r.rhs].value);
+        }
+        return records_[end].value;
+    }
+
+    // Reverse sweep seeded at head. The adjoints are written to the
+    // caller's buffer so that several gradients of one tape can coexist.
+    void backward(index head, std::vector<double>& adjoints) const {
+        backward(&records_[0], position(head), adjoints);
+    }
+
+    // The same sweep over any array of records, from the one at position
+    // head.
+    static void backward(const record* records, index head,
+                         std::vector<double>& adjoints) {
+        adjoints.assign(static_cast<std::size_t>(head) + 1, 0.0);
+        adjoints[head] = 1.0;
+        for (index i = head + 1; i-- > 0;) {
+            const double a = adjoints[i];
+            if (a == 0.0) continue;
+            const record& r = records[i];
+            switch (r.op) {
+                case opcode::add:
+                    adjoints[r.lhs] += a;
+                    adjoints[r.rhs] += a;
+                    break;
+                case opcode::sub:
+                    adjoints[r.lhs] += a;
+                    adjoints[r.rhs] -= a;
+                    break;
+                case opcode::mul:
+                    adjoints[r.lhs] += a * records[r.rhs].value;
+                    adjoints[r.rhs] += a * records[r.lhs].value;
+                    break;
+                case opcode::div: {
+                    double l = records[r.lhs].value;
+                    double d = records[r.rhs].value;
+                    adjoints[r.lhs] += a / d;
+                    adjoints[r.rhs] -= a * l / (d * d);
+                    break;
+                }
+                case opcode::neg:
+                    adjoints[r.lhs] -= a;
+                    break;
+                case opcode::exp:
+                    adjoints[r.lhs] += a * r.value;
+                    break;
+                case opcode::sin:
+                    adjoints[r.lhs] += a * std::cos(records[r.lhs].value);
+                    break;
+                case opcode::cos:
+                    adjoints[r.lhs] -= a * std::sin(records[r.lhs].value);
+                    break;
+                case opcode::ln:
+                    adjoints[r.lhs] += a / records[r.lhs].value;
+                    break;
+                case opcode::log:
+                    adjoints[r.lhs] +=
+                        a / (records[r.lhs].value * std::log(2));
+                    break;
+                case opcode::pow: {
+                    double l = records[r.lhs].value;
+                    double e = records[r.rhs].value;
+                    adjoints[r.lhs] += a * e * std::pow(l, e - 1);
+                    adjoints[r.rhs] += a * r.value * std::log(l);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Rewrites the tape so that the given outputs cost less to evaluate
+    // and differentiate: subtrees over constants only are folded into a
+    // constant, x + 0, x - 0, x * 1, x / 1, x ^ 1 and double negation are
+    // replaced by x, 0 - x becomes -x, and chains of constant scales or
+    // shifts are merged into one. Records that neither an output nor a
+    // variable needs any more are removed, and their number returned.
+    // Indices of removed intermediate results must not be used again.
+    std::size_t simplify(const std::vector<index>& outputs) {
+        const std::size_t before = records_.size();
+        std::vector<record> out;
+        out.reserve(before);
+        // rep[p]: the position in out standing for old record p
+        std::vector<index> rep(before);
+        for (std::size_t p = 0; p < before; ++p) {
+            rep[p] = rewrite(records_[p], rep, out);
+        }
+
+        std::vector<char> live(out.size(), 0);
+        for (index o : outputs) live[rep[position(o)]] = 1;
+        for (std::size_t p = out.size(); p-- > 0;) {
+            const record& r = out[p];
+            if (r.op == opcode::variable) live[p] = 1;
+            if (!live[p] || r.op == opcode::variable ||
+                r.op == opcode::constant) {
+                continue;
+            }
+            live[r.lhs] = 1;
+            if (is_binary(r.op)) live[r.rhs] = 1;
+        }
+
+        std::vector<index> moved(out.size(), dropped);
+        records_.clear();
+        for (std::size_t p = 0; p < out.size(); ++p) {
+            if (!live[p]) continue;
+            record r = out[p];
+            if (r.op != opcode::variable && r.op != opcode::constant) {
+                r.lhs = moved[r.lhs];
+                r.rhs = is_binary(r.op) ? moved[r.rhs] : r.lhs;
+            }
+            moved[p] = static_cast<index>(records_.size());
+            records_.push_back(r);
+        }
+        for (index& s : slots_) {
+            if (s != dropped) s = moved[rep[s]];
+        }
+        if (sharing_) {
+            shapes_.clear();
+            index_shapes();
+        }
+        return before - records_.size();
+    }
+
+    std::size_t simplify(index output) {
+        return simplify(std::vector<index>{output});
+    }
+
+private:
+    static constexpr index dropped = std::numeric_limits<index>::max();
+
+    static tape*& slot() {
+        static thread_local tape* active = nullptr;
+        return active;
+    }
+
+    // Appends the simplified form of r to out, unless an existing record
+    // already stands for it, and returns the position standing for r.
+    static index rewrite(const record& r, const std::vector<index>& rep,
+                         std::vector<record>& out) {
+        auto emit = [&out](opcode op, index l, index d, double v) {
+            out.push_back(record{op, l, d, v});
+            return static_cast<index>(out.size() - 1);
+        };
+        auto is_constant = [&out](index p, double c) {
+            return out[p].op == opcode::constant && out[p].value == c;
+        };
+        if (r.op == opcode::variable || r.op == opcode::constant) {
+            return emit(r.op, 0, 0, r.value);
+        }
+        const bool binary = is_binary(r.op);
+        index l = rep[r.lhs];
+        index d = binary ? rep[r.rhs] : l;
+        const record L = out[l];
+        const record D = out[d];
+        const double v = apply(r.op, L.value, D.value);
+
+        if (L.op == opcode::constant && D.op == opcode::constant) {
+            return emit(opcode::constant, 0, 0, v);
+        }
+        switch (r.op) {
+            case opcode::add:
+                if (is_constant(d, 0)) return l;
+                if (is_constant(l, 0)) return d;
+                break;
+            case opcode::sub:
+                if (is_constant(d, 0)) return l;
+                if (is_constant(l, 0)) {
+                    if (D.op == opcode::neg) return D.lhs;
+                    return emit(opcode::neg, d, d, v);
+                }
+                break;
+            case opcode::mul:
+                if (is_constant(d, 1)) return l;
+                if (is_constant(l, 1)) return d;
+                break;
+            case opcode::div:
+            case opcode::pow:
+                if (is_constant(d, 1)) return l;
+                break;
+            case opcode::neg:
+                if (L.op == opcode::neg) return L.lhs;
+                break;
+            default:
+                break;
+        }
+
+        // (x op a) op b with constants a and b becomes x op' c: scales
+        // multiply and shifts add up.
+        index x;
+        double a;
+        double b;
+        if ((r.op == opcode::mul || r.op == opcode::div) &&
+            D.op == opcode::constant && scale(out, l, x, a)) {
+            b = r.op == opcode::mul ? D.value : 1 / D.value;
+            if (a * b == 1) return x;
+            index c = emit(opcode::constant, 0, 0, a * b);
+            return emit(opcode::mul, x, c, v);
+        }
+        if (r.op == opcode::mul && L.op == opcode::constant &&
+            scale(out, d, x, a)) {
+            if (a * L.value == 1) return x;
+            index c = emit(opcode::constant, 0, 0, a * L.value);
+            return emit(opcode::mul, x, c, v);
+        }
+        if ((r.op == opcode::add || r.op == opcode::sub) &&
+            D.op == opcode::constant && shift(out, l, x, a)) {
+            b = r.op == opcode::add ? D.value : -D.value;
+            if (a + b == 0) return x;
+            index c = emit(opcode::constant, 0, 0, a + b);
+            return emit(opcode::add, x, c, v);
+        }
+        if (r.op == opcode::add && L.op == opcode::constant &&
+            shift(out, d, x, a)) {
+            if (a + L.value == 0) return x;
+            index c = emit(opcode::constant, 0, 0, a + L.value);
+            return emit(opcode::add, x, c, v);
+        }
+        return emit(r.op, l, d, v);
+    }
+
+    // Whether record p is x * a, a * x or x / a for a constant a.
+    static bool scale(const std::vector<record>& out, index p, index& x,
+                      double& a) {
+        const record& r = out[p];
+        if (r.op == opcode::mul && out[r.rhs].op == opcode::constant) {
+            x = r.lhs;
+            a = out[r.rhs].value;
+            return true;
+        }
+        if (r.op == opcode::mul && out[r.lhs].op == opcode::constant) {
+            x = r.rhs;
+            a = out[r.lhs].value;
+            return true;
+        }
+        if (r.op == opcode::div && out[r.rhs].op == opcode::constant) {
+            x = r.lhs;
+            a = 1 / out[r.rhs].value;
+            return true;
+        }
+        return false;
+    }
+
+    // Whether record p is x + a, a + x or x - a for a constant a.
+    static bool shift(const std::vector<record>& out, index p, index& x,
+                      double& a) {
+        const record& r = out[p];
+        if (r.op == opcode::add && out[r.rhs].op == opcode::constant) {
+            x = r.lhs;
+            a = out[r.rhs].value;
+            return true;
+        }
+        if (r.op == opcode::add && out[r.lhs].op == opcode::constant) {
+            x = r.rhs;
+            a = out[r.lhs].value;
+            return true;
+        }
+        if (r.op == opcode::sub && out[r.rhs].op == opcode::constant) {
+            x = r.lhs;
+            a = -out[r.rhs].value;
+            return true;
+        }
+        return false;
+    }
+
+    static shape key(const record& r) {
+        if (r.op == opcode::constant) return shape::of(r.value);
+        return shape::of(r.op, r.lhs, r.rhs);
+    }
+
+    void index_shapes() {
+        for (std::size_t p = 0; p < records_.size(); ++p) {
+            if (records_[p].op == opcode::variable) continue;
+            shapes_.emplace(key(records_[p]), static_cast<index>(p));
+        }
+    }
+
+    storage<record> records_;
+    // index -> position, or dropped
+    storage<index> slots_;
+    bool sharing_ = false;
+    std::unordered_map<shape, index, shape::hash> shapes_;
+};
+
+}  // namespace base
+}  // namespace autodiff
@@ -0,0 +1,704 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "pool.hpp"
+
+namespace autodiff {
+namespace tensor {
+
+// Array-valued variables. Every operation on arrays is a single node of
+// a graph of its own, holding its whole result in one contiguous buffer,
+// and forward and reverse passes run one loop over each buffer instead of
+// one node per element. The loops are plain and unit-stride, so that the
+// compiler vectorises them (see AUTODIFF_NATIVE); reductions keep several
+// partial sums for the same reason. The operations and their derivatives
+// are those of base::var; ln is the natural logarithm and log the base-2
+// one.
+
+enum class kind {
+    variable,
+    constant,
+    add,
+    sub,
+    mul,
+    div,
+    pow,
+    // l * s + t, for operations with a scalar
+    affine,
+    // s / l
+    reciprocal,
+    // l ^ s
+    power,
+    exp,
+    sin,
+    cos,
+    ln,
+    log,
+    sum,
+    dot,
+    norm,
+    // lhs rows x lhs cols times rhs, a matrix or a column
+    matmul,
+    transpose
+};
+
+// One node of an array graph. Operands always exist before the nodes
+// that use them, so the graph is acyclic.
+struct node {
+    kind op;
+    std::size_t rows;
+    std::size_t cols;
+    std::vector<double> value;
+    std::shared_ptr<node> lhs;
+    std::shared_ptr<node> rhs;
+    double s = 1;
+    double t = 0;
+    // whether any variable is among its operands, i.e. whether it can
+    // have an adjoint
+    bool active = false;
+
+    std::size_t size() const { return value.size(); }
+};
+
+// Lets matrix products on this thread share their work out over a pool
+// for its lifetime, once they take at least threshold multiply-adds, and
+// restores the previous setting afterwards.
+class parallel {
+public:
+    explicit parallel(base::thread_pool& pool,
+                      std::size_t threshold = std::size_t(1) << 18)
+        : previous_(slot()) {
+        slot() = {&pool, threshold};
+    }
+    ~parallel() { slot() = previous_; }
+
+    parallel(const parallel&) = delete;
+    parallel& operator=(const parallel&) = delete;
+
+    // Calls f(first, last) on ranges of rows covering [0, rows), on the
+    // pool's workers if work is large enough to be worth it.
+    template <typename F>
+    static void rows(std::size_t rows, std::size_t work, F&& f) {
+        const setting& s = slot();
+        if (!s.pool || s.pool->size() == 1 || work < s.threshold ||
+            rows < 2) {
+            f(std::size_t(0), rows);
+            return;
+        }
+        const std::size_t tasks = std::min(rows, 4 * s.pool->size());
+        s.pool->parallel_for(tasks, [&](std::size_t t, std::size_t) {
+            f(rows * t / tasks, rows * (t + 1) / tasks);
+        });
+    }
+
+private:
+    struct setting {
+        base::thread_pool* pool = nullptr;
+        std::size_t threshold = 0;
+    };
+
+    static setting& slot() {
+        static thread_local setting s;
+        return s;
+    }
+
+    setting previous_;
+};
+
+namespace kernels {
+
+// The sum of a[0 .. n) * b[0 .. n), or of a alone when b is null, with
+// four independent partial sums that map onto vector lanes.
+inline double reduce(const double* a, const double* b, std::size_t n) {
+    double acc[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    if (b) {
+        for (; i + 4 <= n; i += 4) {
+            acc[0] += a[i] * b[i];
+            acc[1] += a[i + 1] * b[i + 1];
+            acc[2] += a[i + 2] * b[i + 2];
+            acc[3] += a[i + 3] * b[i + 3];
+        }
+        for (; i < n; ++i) acc[0] += a[i] * b[i];
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            acc[0] += a[i];
+            acc[1] += a[i + 1];
+            acc[2] += a[i + 2];
+            acc[3] += a[i + 3];
+        }
+        for (; i < n; ++i) acc[0] += a[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+// c += a b for row-major a (m x k), b (k x n) and c (m x n). Every row
+// of c is built from rows of b scaled by the entries of a, the innermost
+// loop running along a row; blocks of b are sized to stay in cache while
+// a block of rows of c passes over them.
+inline void gemm(std::size_t m, std::size_t n, std::size_t k,
+                 const double* a, const double* b, double* c) {
+    constexpr std::size_t kb = 128;
+    constexpr std::size_t nb = 512;
+    if (n == 1) {
+        parallel::rows(m, m * k, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+                c[i] += reduce(a + i * k, b, k);
+            }
+        });
+        return;
+    }
+    parallel::rows(m, m * n * k, [&](std::size_t first, std::size_t last) {
+        for (std::size_t p0 = 0; p0 < k; p0 += kb) {
+            const std::size_t p1 = std::min(k, p0 + kb);
+            for (std::size_t j0 = 0; j0 < n; j0 += nb) {
+                const std::size_t j1 = std::min(n, j0 + nb);
+                for (std::size_t i = first; i < last; ++i) {
+                    double* ci = c + i * n;
+                    for (std::size_t p = p0; p < p1; ++p) {
+                        const double aip = a[i * k + p];
+                        const double* bp = b + p * n;
+                        for (std::size_t j = j0; j < j1; ++j) {
+                            ci[j] += aip * bp[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// t = the transpose of a (m x n), in square tiles so that both sides are
+// read and written a few cache lines at a time.
+inline void transpose(std::size_t m, std::size_t n, const double* a,
+                      double* t) {
+    constexpr std::size_t tb = 32;
+    for (std::size_t i0 = 0; i0 < m; i0 += tb) {
+        const std::size_t i1 = std::min(m, i0 + tb);
+        for (std::size_t j0 = 0; j0 < n; j0 += tb) {
+            const std::size_t j1 = std::min(n, j0 + tb);
+            for (std::size_t i = i0; i < i1; ++i) {
+                for (std::size_t j = j0; j < j1; ++j) {
+                    t[j * m + i] = a[i * n + j];
+                }
+            }
+        }
+    }
+}
+
+// Computes the value of n from its operands.
+inline void forward(node& n) {
+    double* v = n.value.data();
+    const std::size_t m = n.size();
+    const double* l = n.lhs ? n.lhs->value.data() : nullptr;
+    const double* r = n.rhs ? n.rhs->value.data() : nullptr;
+    const double s = n.s;
+    const double t = n.t;
+    switch (n.op) {
+        case kind::add:
+            for (std::size_t k = 0; k < m; ++k) v[k] = l[k] + r[k];
+            break;
+        case kind::sub:
+            for (std::size_t k = 0; k < m; ++k) v[k] = l[k] - r[k];
+            break;
+        case kind::mul:
+            for (std::size_t k = 0; k < m; ++k) v[k] = l[k] * r[k];
+            break;
+        case kind::div:
+            for (std::size_t k = 0; k < m; ++k) v[k] = l[k] / r[k];
+            break;
+        case kind::pow:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::pow(l[k], r[k]);
+            break;
+        case kind::affine:
+            for (std::size_t k = 0; k < m; ++k) v[k] = l[k] * s + t;
+            break;
+        case kind::reciprocal:
+            for (std::size_t k = 0; k < m; ++k) v[k] = s / l[k];
+            break;
+        case kind::power:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::pow(l[k], s);
+            break;
+        case kind::exp:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::exp(l[k]);
+            break;
+        case kind::sin:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::sin(l[k]);
+            break;
+        case kind::cos:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::cos(l[k]);
+            break;
+        case kind::ln:
+            for (std::size_t k = 0; k < m; ++k) v[k] = std::log(l[k]);
+            break;
+        case kind::log:
+            for (std::size_t k = 0; k < m; ++k) {
+                v[k] = std::log(l[k]) / std::log(2);
+            }
+            break;
+        case kind::sum:
+            v[0] = reduce(l, nullptr, n.lhs->size());
+            break;
+        case kind::dot:
+            v[0] = reduce(l, r, n.lhs->size());
+            break;
+        case kind::norm:
+            v[0] = std::sqrt(reduce(l, l, n.lhs->size()));
+            break;
+        case kind::matmul:
+            std::fill(v, v + m, 0.0);
+            gemm(n.rows, n.cols, n.lhs->cols, l, r, v);
+            break;
+        case kind::transpose:
+            transpose(n.lhs->rows, n.lhs->cols, l, v);
+            break;
+        default:
+            break;
+    }
+}
+
+// Adds the adjoint a of n into those of its operands, al and ar, either
+// of which is null when that operand has none.
+inline void backward(const node& n, const double* a, double* al,
+                     double* ar) {
+    const double* v = n.value.data();
+    const std::size_t m = n.size();
+    const double* l = n.lhs ? n.lhs->value.data() : nullptr;
+    const double* r = n.rhs ? n.rhs->value.data() : nullptr;
+    const double s = n.s;
+    switch (n.op) {
+        case kind::add:
+            if (al) for (std::size_t k = 0; k < m; ++k) al[k] += a[k];
+            if (ar) for (std::size_t k = 0; k < m; ++k) ar[k] += a[k];
+            break;
+        case kind::sub:
+            if (al) for (std::size_t k = 0; k < m; ++k) al[k] += a[k];
+            if (ar) for (std::size_t k = 0; k < m; ++k) ar[k] -= a[k];
+            break;
+        case kind::mul:
+            if (al) for (std::size_t k = 0; k < m; ++k) al[k] += a[k] * r[k];
+            if (ar) for (std::size_t k = 0; k < m; ++k) ar[k] += a[k] * l[k];
+            break;
+        case kind::div:
+            if (al) for (std::size_t k = 0; k < m; ++k) al[k] += a[k] / r[k];
+            if (ar) {
+                for (std::size_t k = 0; k < m; ++k) ar[k] -= a[k] * v[k] / r[k];
+            }
+            break;
+        case kind::pow:
+            if (al) {
+                for (std::size_t k = 0; k < m; ++k) {
+                    al[k] += a[k] * r[k] * std::pow(l[k], r[k] - 1);
+                }
+            }
+            if (ar) {
+                for (std::size_t k = 0; k < m; ++k) {
+                    ar[k] += a[k] * v[k] * std::log(l[k]);
+                }
+            }
+            break;
+        case kind::affine:
+            for (std::size_t k = 0; k < m; ++k) al[k] += a[k] * s;
+            break;
+        case kind::reciprocal:
+            for (std::size_t k = 0; k < m; ++k) al[k] -= a[k] * v[k] / l[k];
+            break;
+        case kind::power:
+            for (std::size_t k = 0; k < m; ++k) {
+                al[k] += a[k] * s * std::pow(l[k], s - 1);
+            }
+            break;
+        case kind::exp:
+            for (std::size_t k = 0; k < m; ++k) al[k] += a[k] * v[k];
+            break;
+        case kind::sin:
+            for (std::size_t k = 0; k < m; ++k) al[k] += a[k] * std::cos(l[k]);
+            break;
+        case kind::cos:
+            for (std::size_t k = 0; k < m; ++k) al[k] -= a[k] * std::sin(l[k]);
+            break;
+        case kind::ln:
+            for (std::size_t k = 0; k < m; ++k) al[k] += a[k] / l[k];
+            break;
+        case kind::log:
+            for (std::size_t k = 0; k < m; ++k) {
+                al[k] += a[k] / (l[k] * std::log(2));
+            }
+            break;
+        case kind::sum: {
+            const double g = a[0];
+            const std::size_t p = n.lhs->size();
+            for (std::size_t k = 0; k < p; ++k) al[k] += g;
+            break;
+        }
+        case kind::dot: {
+            const double g = a[0];
+            const std::size_t p = n.lhs->size();
+            if (al) for (std::size_t k = 0; k < p; ++k) al[k] += g * r[k];
+            if (ar) for (std::size_t k = 0; k < p; ++k) ar[k] += g * l[k];
+            break;
+        }
+        case kind::norm: {
+            if (v[0] == 0) break;
+            const double g = a[0] / v[0];
+            const std::size_t p = n.lhs->size();
+            for (std::size_t k = 0; k < p; ++k) al[k] += g * l[k];
+            break;
+        }
+        case kind::matmul: {
+            // c = l r: dl = dc r^T and dr = l^T dc
+            const std::size_t rows = n.rows;
+            const std::size_t inner = n.lhs->cols;
+            const std::size_t cols = n.cols;
+            std::vector<double> t;
+            if (al && cols == 1) {
+                parallel::rows(rows, rows * inner,
+                               [&](std::size_t first, std::size_t last) {
+                    for (std::size_t i = first; i < last; ++i) {
+                        double* li = al + i * inner;
+                        for (std::size_t p = 0; p < inner; ++p) {
+                            li[p] += a[i] * r[p];
+                        }
+                    }
+                });
+            } else if (al) {
+                t.resize(inner * cols);
+                transpose(inner, cols, r, t.data());
+                gemm(rows, inner, cols, a, t.data(), al);
+            }
+            if (ar && cols == 1) {
+                for (std::size_t i = 0; i < rows; ++i) {
+                    const double* li = l + i * inner;
+                    for (std::size_t p = 0; p < inner; ++p) {
+                        ar[p] += a[i] * li[p];
+                    }
+                }
+            } else if (ar) {
+                t.resize(rows * inner);
+                transpose(rows, inner, l, t.data());
+                gemm(inner, cols, rows, t.data(), a, ar);
+            }
+            break;
+        }
+        case kind::transpose: {
+            const std::size_t rows = n.rows;
+            const std::size_t cols = n.cols;
+            for (std::size_t j = 0; j < cols; ++j) {
+                for (std::size_t i = 0; i < rows; ++i) {
+                    al[j * rows + i] += a[i * cols + j];
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+}  // namespace kernels
+
+class array {
+public:
+    // A column of variables.
+    explicit array(const std::vector<double>& values)
+        : array(values.size(), 1, values) {}
+
+    // A rows x cols matrix of variables, stored row by row.
+    array(std::size_t rows, std::size_t cols, std::vector<double> values)
+        : node_(std::make_shared<node>()) {
+        if (values.size() != rows * cols) {
+            throw std::invalid_argument(
+                "autodiff: values do not fill the shape");
+        }
+        node_->op = kind::variable;
+        node_->rows = rows;
+        node_->cols = cols;
+        node_->value = std::move(values);
+        node_->active = true;
+    }
+
+    // Data the graph is not differentiated with respect to.
+    static array constant(std::size_t rows, std::size_t cols,
+                          std::vector<double> values) {
+        array a(rows, cols, std::move(values));
+        a.node_->op = kind::constant;
+        a.node_->active = false;
+        return a;
+    }
+    static array constant(const std::vector<double>& values) {
+        return constant(values.size(), 1, values);
+    }
+
+    std::size_t rows() const { return node_->rows; }
+    std::size_t cols() const { return node_->cols; }
+    std::size_t size() const { return node_->size(); }
+
+    const double* data() const { return node_->value.data(); }
+    double operator[](std::size_t i) const { return node_->value[i]; }
+    // The value of a single-element array, such as a reduction.
+    double value() const {
+        if (size() != 1) {
+            throw std::logic_error("autodiff: array has more than one value");
+        }
+        return node_->value[0];
+    }
+
+    const std::shared_ptr<node>& get_node() const { return node_; }
+
+    friend void set_value(array& a, const std::vector<double>& values) {
+        if (a.node_->op != kind::variable && a.node_->op != kind::constant) {
+            throw std::logic_error("autodiff: only leaves can be set");
+        }
+        if (values.size() != a.size()) {
+            throw std::invalid_argument(
+                "autodiff: values do not fill the shape");
+        }
+        a.node_->value = values;
+    }
+
+    // Recomputes every node from the current values of the leaves.
+    void forward_pass() {
+        for (node* n : topological_order()) kernels::forward(*n);
+    }
+
+    // Every node this array depends on once, operands first.
+    std::vector<node*> topological_order() const {
+        std::vector<node*> order;
+        std::unordered_set<const node*> seen;
+        std::vector<std::pair<node*, bool>> stack{{node_.get(), false}};
+        while (!stack.empty()) {
+            auto [n, expanded] = stack.back();
+            stack.pop_back();
+            if (expanded) {
+                order.push_back(n);
+                continue;
+            }
+            if (!seen.insert(n).second) continue;
+            stack.push_back({n, true});
+            if (n->rhs && !seen.count(n->rhs.get())) {
+                stack.push_back({n->rhs.get(), false});
+            }
+            if (n->lhs && !seen.count(n->lhs.get())) {
+                stack.push_back({n->lhs.get(), false});
+            }
+        }
+        return order;
+    }
+
+    friend array operator+(const array& l, const array& r) {
+        return link(kind::add, l, r);
+    }
+    friend array operator-(const array& l, const array& r) {
+        return link(kind::sub, l, r);
+    }
+    friend array operator*(const array& l, const array& r) {
+        return link(kind::mul, l, r);
+    }
+    friend array operator/(const array& l, const array& r) {
+        return link(kind::div, l, r);
+    }
+    friend array pow(const array& l, const array& r) {
+        return link(kind::pow, l, r);
+    }
+
+    friend array operator+(const array& l, double c) {
+        return affine(l, 1, c);
+    }
+    friend array operator+(double c, const array& r) {
+        return affine(r, 1, c);
+    }
+    friend array operator-(const array& l, double c) {
+        return affine(l, 1, -c);
+    }
+    friend array operator-(double c, const array& r) {
+        return affine(r, -1, c);
+    }
+    friend array operator*(const array& l, double c) {
+        return affine(l, c, 0);
+    }
+    friend array operator*(double c, const array& r) {
+        return affine(r, c, 0);
+    }
+    friend array operator/(const array& l, double c) {
+        return affine(l, 1 / c, 0);
+    }
+    friend array operator/(double c, const array& r) {
+        array a = unary(kind::reciprocal, r, r.rows(), r.cols());
+        a.node_->s = c;
+        kernels::forward(*a.node_);
+        return a;
+    }
+    friend array operator-(const array& a) { return affine(a, -1, 0); }
+    friend array pow(const array& l, double c) {
+        array a = unary(kind::power, l, l.rows(), l.cols());
+        a.node_->s = c;
+        kernels::forward(*a.node_);
+        return a;
+    }
+
+    friend array exp(const array& a) { return elementwise(kind::exp, a); }
+    friend array sin(const array& a) { return elementwise(kind::sin, a); }
+    friend array cos(const array& a) { return elementwise(kind::cos, a); }
+    friend array ln(const array& a) { return elementwise(kind::ln, a); }
+    friend array log(const array& a) { return elementwise(kind::log, a); }
+
+    // The sum of all elements.
+    friend array sum(const array& a) {
+        return elementwise(kind::sum, a, true);
+    }
+    // The sum of the products of corresponding elements.
+    friend array dot(const array& l, const array& r) {
+        return link(kind::dot, l, r, true);
+    }
+    // The Euclidean norm of all elements.
+    friend array norm(const array& a) {
+        return elementwise(kind::norm, a, true);
+    }
+
+    // The matrix product l r, of l.rows() x r.cols().
+    friend array matmul(const array& l, const array& r) {
+        if (l.cols() != r.rows()) {
+            throw std::invalid_argument(
+                "autodiff: matrix shapes do not conform");
+        }
+        array a = make(kind::matmul, &l, &r, l.rows(), r.cols());
+        kernels::forward(*a.node_);
+        return a;
+    }
+    // The product of the matrix l and the column x.
+    friend array matvec(const array& l, const array& x) {
+        if (x.cols() != 1) {
+            throw std::invalid_argument("autodiff: matvec needs a column");
+        }
+        return matmul(l, x);
+    }
+    friend array transpose(const array& a) {
+        array t = unary(kind::transpose, a, a.cols(), a.rows());
+        kernels::forward(*t.node_);
+        return t;
+    }
+
+private:
+    explicit array(std::shared_ptr<node> n) : node_(std::move(n)) {}
+
+    // A new node over l and r with the given shape, not yet evaluated.
+    static array make(kind op, const array* l, const array* r,
+                      std::size_t rows, std::size_t cols) {
+        auto n = std::make_shared<node>();
+        n->op = op;
+        n->rows = rows;
+        n->cols = cols;
+        n->value.resize(rows * cols);
+        if (l) {
+            n->lhs = l->node_;
+            n->active = l->node_->active;
+        }
+        if (r) {
+            n->rhs = r->node_;
+            n->active = n->active || r->node_->active;
+        }
+        return array(std::move(n));
+    }
+
+    static array unary(kind op, const array& l, std::size_t rows,
+                       std::size_t cols) {
+        return make(op, &l, nullptr, rows, cols);
+    }
+
+    // reductions give a single element
+    static array link(kind op, const array& l, const array& r,
+                      bool reduce = false) {
+        if (l.rows() != r.rows() || l.cols() != r.cols()) {
+            throw std::invalid_argument("autodiff: array shapes differ");
+        }
+        array a = reduce ? make(op, &l, &r, 1, 1)
+                       : make(op, &l, &r, l.rows(), l.cols());
+        kernels::forward(*a.node_);
+        return a;
+    }
+
+    static array elementwise(kind op, const array& l, bool reduce = false) {
+        array a = reduce ? unary(op, l, 1, 1)
+                         : unary(op, l, l.rows(), l.cols());
+        kernels::forward(*a.node_);
+        return a;
+    }
+
+    static array affine(const array& l, double s, double t) {
+        array a = unary(kind::affine, l, l.rows(), l.cols());
+        a.node_->s = s;
+        a.node_->t = t;
+        kernels::forward(*a.node_);
+        return a;
+    }
+
+    std::shared_ptr<node> node_;
+};
+
+// The adjoints of every array y depends on, by one reverse sweep over
+// whole buffers. y is seeded with ones, so an array-valued y gives the
+// gradient of the sum of its elements.
+class gradient {
+public:
+    explicit gradient(const array& y) : head_(y.get_node()) {
+        order_ = y.topological_order();
+        adjoints_.resize(order_.size());
+        for (std::size_t i = 0; i < order_.size(); ++i) {
+            position_.emplace(order_[i], i);
+        }
+        grad();
+    }
+
+    // d y / d x, element by element; zeros when y does not depend on x.
+    const std::vector<double>& operator[](const array& x) {
+        auto p = position_.find(x.get_node().get());
+        if (p != position_.end() && !adjoints_[p->second].empty()) {
+            return adjoints_[p->second];
+        }
+        auto& z = zeros_[x.get_node().get()];
+        z.assign(x.size(), 0.0);
+        return z;
+    }
+
+    // Recomputes the adjoints at the current values.
+    void grad() {
+        for (std::size_t i = 0; i < order_.size(); ++i) {
+            if (order_[i]->active) {
+                adjoints_[i].assign(order_[i]->size(), 0.0);
+            }
+        }
+        if (!head_->active) return;
+        std::vector<double>& seed = adjoints_.back();
+        seed.assign(seed.size(), 1.0);
+        for (std::size_t i = order_.size(); i-- > 0;) {
+            const node& n = *order_[i];
+            if (!n.active || !n.lhs) continue;
+            kernels::backward(n, adjoints_[i].data(), adjoint(n.lhs.get()),
+                              adjoint(n.rhs.get()));
+        }
+    }
+
+private:
+    double* adjoint(const node* n) {
+        if (!n || !n->active) return nullptr;
+        return adjoints_[position_.at(n)].data();
+    }
+
+    std::shared_ptr<node> head_;
+    std::vector<node*> order_;
+    std::unordered_map<const node*, std::size_t> position_;
+    std::vector<std::vector<double>> adjoints_;
+    std::unordered_map<const node*, std::vector<double>> zeros_;
+};
+
+}  // namespace tensor
+}  // namespace autodiff
@@ -0,0 +1,73 @@
+#include "arena.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdint>
+
+using namespace autodiff;
+using namespace base;
+
+TEST(arena, bump_allocation) {
+    arena a(1024);
+    void* p = a.allocate(3, 1);
+    void* q = a.allocate(8, 8);
+    ASSERT_NE(p, q);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(q) % 8, 0);
+    ASSERT_EQ(a.used(), 11);
+
+    void* big = a.allocate(4096, 16);
+    ASSERT_NE(big, nullptr);
+    ASSERT_GE(a.capacity(), 1024 + 4096);
+}
+
+TEST(arena, reset_reuses_memory) {
+    arena a(1024);
+    void* p = a.allocate(64, 8);
+    std::size_t capacity = a.capacity();
+    a.reset();
+    ASSERT_EQ(a.used(), 0);
+    ASSERT_EQ(a.allocate(64, 8), p);
+    ASSERT_EQ(a.capacity(), capacity);
+}
+
+TEST(arena, scope) {
+    arena a;
+    ASSERT_EQ(arena::active(), nullptr);
+    {
+        arena::scope s(a);
+        ASSERT_EQ(arena::active(), &a);
+    }
+    ASSERT_EQ(arena::active(), nullptr);
+}
+
+TEST(arena, nodes_come_from_arena) {
+    arena a;
+    for (int i = 0; i < 3; ++i) {
+        {
+            arena::scope s(a);
+            var c(2);
+            var d(5);
+            auto y = (c + d) * d;
+            ASSERT_GT(a.used(), 0);
+            auto Y = gradient(y);
+            ASSERT_EQ(Y[c], 5);
+            ASSERT_EQ(Y[d], 12);
+        }
+        a.reset();
+    }
+}
+
+TEST(arena, changing_values) {
+    arena a;
+    arena::scope s(a);
+    auto exp_ = autodiff::functions::exp();
+    var x(3);
+    var y(2);
+    auto f = exp_(x + y * y);
+    set_value(x, 1);
+    f.forward_pass();
+    auto F = gradient(f);
+    ASSERT_NEAR(f.value(), std::exp(5.0), 1e-9);
+    ASSERT_NEAR(F[x], std::exp(5.0), 1e-9);
+    ASSERT_NEAR(F[y], 4 * std::exp(5.0), 1e-9);
+}
@@ -0,0 +1,120 @@
+#include "batch.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+using namespace autodiff;
+using namespace base;
+
+template <typename T>
+T model(T& x, T& y) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+    return y / (y + exp_(-x)) + sin_(x * y) * x - cos_(y) +
+           ln_(x * x + 1.0) * log_(y) + pow_(x, y);
+}
+
+TEST(batch, matches_pointwise_gradient) {
+    tape t;
+    tape::recording r(t);
+    var x(1);
+    var y(1);
+    auto z = model(x, y);
+
+    batch b(z, 5);
+    for (std::size_t k = 0; k < b.width(); ++k) {
+        b.values(x)[k] = 0.5 + 0.25 * k;
+        b.values(y)[k] = 2.0 - 0.3 * k;
+    }
+    b.forward();
+    b.backward();
+
+    for (std::size_t k = 0; k < b.width(); ++k) {
+        set_value(x, 0.5 + 0.25 * k);
+        set_value(y, 2.0 - 0.3 * k);
+        double v = z.forward_pass();
+        auto Z = gradient(z);
+        ASSERT_NEAR(b.values(z)[k], v, 1e-12);
+        ASSERT_NEAR(b.adjoints(x)[k], Z[x], 1e-12);
+        ASSERT_NEAR(b.adjoints(y)[k], Z[y], 1e-12);
+    }
+}
+
+TEST(batch, unset_inputs_keep_recorded_values) {
+    tape t;
+    tape::recording r(t);
+    var x(3);
+    var c(4);
+    auto z = x * c;
+
+    batch b(z, 3);
+    b.values(x)[0] = 1;
+    b.values(x)[1] = 2;
+    b.values(x)[2] = 3;
+    b.forward();
+    b.backward();
+    ASSERT_EQ(b.values(z)[1], 8);
+    ASSERT_EQ(b.adjoints(x)[2], 4);
+    ASSERT_EQ(b.adjoints(c)[2], 3);
+}
+
+TEST(batch, rejects_unrecorded_vars) {
+    var x(1);
+    auto z = x * x;
+    ASSERT_THROW(batch(z, 4), std::logic_error);
+
+    tape t;
+    tape::recording r(t);
+    var a(1);
+    auto y = a * a;
+    batch b(y, 4);
+    ASSERT_THROW(b.values(x), std::logic_error);
+}
+
+TEST(batch, gradient_batch_matches_pointwise) {
+    tape t;
+    tape::recording r(t);
+    var x(1);
+    var y(1);
+    auto z = model(x, y);
+
+    const std::size_t count = 1000;
+    std::vector<double> points;
+    for (std::size_t p = 0; p < count; ++p) {
+        points.push_back(0.5 + 0.001 * p);
+        points.push_back(2.0 - 0.0007 * p);
+    }
+    thread_pool pool(4);
+    auto G = gradient_batch(z, {x, y}, points, pool, 64);
+    ASSERT_EQ(G.values.size(), count);
+
+    for (std::size_t p = 0; p < count; p += 37) {
+        set_value(x, points[2 * p]);
+        set_value(y, points[2 * p + 1]);
+        double v = z.forward_pass();
+        auto Z = gradient(z);
+        ASSERT_NEAR(G.value(p), v, 1e-12);
+        ASSERT_NEAR(G(p, 0), Z[x], 1e-12);
+        ASSERT_NEAR(G(p, 1), Z[y], 1e-12);
+    }
+
+    auto H = gradient_batch(z, {x, y}, points, 1);
+    ASSERT_EQ(H.gradients, G.gradients);
+}
+
+TEST(batch, gradient_batch_checks_its_input) {
+    tape t;
+    tape::recording r(t);
+    var x(1);
+    var y(1);
+    auto z = x * y;
+    ASSERT_THROW(gradient_batch(z, {x, y}, {1, 2, 3}, 2),
+                 std::invalid_argument);
+    var w(2);
+    ASSERT_THROW(gradient_batch(z, {x, w}, {1, 2}, 2), std::logic_error);
+}
@@ -0,0 +1,119 @@
+#include "checkpoint.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// A damped pendulum under explicit Euler: state (angle, velocity),
+// parameters (damping, length).
+std::vector<var> pendulum(const std::vector<var>& s,
+                          const std::vector<var>& p, std::size_t) {
+    auto sin_ = functions::sin();
+    var angle = s[0];
+    var velocity = s[1];
+    var damping = p[0];
+    var length = p[1];
+    var a = sin_(angle) * -9.81 / length - damping * velocity;
+    return {angle + velocity * 0.01, velocity + a * 0.01};
+}
+
+var energy(const std::vector<var>& s) {
+    auto cos_ = functions::cos();
+    var v = s[1];
+    var a = s[0];
+    return v * v * 0.5 + (1 - cos_(a)) * 9.81;
+}
+
+const std::vector<double> x0{1.0, 0.0};
+const std::vector<double> theta{0.1, 2.0};
+
+// The same gradient with every step recorded on one tape.
+checkpoint::result reference(std::size_t steps) {
+    tape t;
+    tape::recording r(t);
+    std::vector<var> s{var(x0[0]), var(x0[1])};
+    std::vector<var> p{var(theta[0]), var(theta[1])};
+    std::vector<var> y = s;
+    for (std::size_t i = 0; i < steps; ++i) y = pendulum(y, p, i);
+    var e = energy(y);
+    auto G = gradient(e);
+    return {e.value(), {G[s[0]], G[s[1]]}, {G[p[0]], G[p[1]]}};
+}
+
+void expect_same(const checkpoint::result& a, const checkpoint::result& b) {
+    ASSERT_NEAR(a.value, b.value, 1e-12);
+    for (std::size_t k = 0; k < 2; ++k) {
+        ASSERT_NEAR(a.state[k], b.state[k], 1e-10) << k;
+        ASSERT_NEAR(a.parameters[k], b.parameters[k], 1e-10) << k;
+    }
+}
+
+}  // namespace
+
+TEST(checkpoint, binomial_matches_full_tape) {
+    const std::size_t steps = 200;
+    auto expected = reference(steps);
+    for (std::size_t s : {0, 1, 2, 3, 5, 10, 199, 500}) {
+        checkpoint c(pendulum, energy, steps, s);
+        expect_same(c.gradient(x0, theta), expected);
+        ASSERT_LE(c.last().peak_snapshots, s) << s;
+        // one step is recorded at a time
+        ASSERT_LT(c.last().peak_records, 100) << s;
+    }
+}
+
+TEST(checkpoint, snapshots_trade_for_evaluations) {
+    const std::size_t steps = 1000;
+    checkpoint c(pendulum, energy, steps, 2);
+    c.gradient(x0, theta);
+    auto few = c.last();
+    c.keep(10);
+    c.gradient(x0, theta);
+    auto more = c.last();
+    c.keep(steps);
+    c.gradient(x0, theta);
+    auto all = c.last();
+
+    ASSERT_GT(few.evaluations, more.evaluations);
+    ASSERT_GT(more.evaluations, all.evaluations);
+    ASSERT_LT(few.peak_bytes, more.peak_bytes);
+    ASSERT_LT(more.peak_bytes, all.peak_bytes);
+    // every step advanced once and recorded once
+    ASSERT_EQ(all.evaluations, 2 * steps - 1);
+    // C(10 + 3, 10) = 286 < 1000 <= C(10 + 4, 10): each step at most 5 times
+    ASSERT_LE(more.evaluations, 5 * steps);
+}
+
+TEST(checkpoint, segments) {
+    const std::size_t steps = 120;
+    auto expected = reference(steps);
+    checkpoint c(pendulum, energy, steps, 0);
+    c.segments({40, 80, 0, 80, 500});
+    expect_same(c.gradient(x0, theta), expected);
+    ASSERT_EQ(c.last().peak_snapshots, 2);
+    ASSERT_EQ(c.last().evaluations, 80 + steps);
+
+    // no marks: the whole simulation on one tape
+    c.segments({});
+    expect_same(c.gradient(x0, theta), expected);
+    auto whole = c.last();
+    ASSERT_EQ(whole.evaluations, steps);
+    ASSERT_GT(whole.peak_records, 40 * c.last().peak_records / steps);
+}
+
+TEST(checkpoint, errors) {
+    checkpoint none(pendulum, energy, 0, 1);
+    ASSERT_THROW(none.gradient(x0, theta), std::invalid_argument);
+    checkpoint shrinking(
+        [](const std::vector<var>& s, const std::vector<var>&, std::size_t) {
+            return std::vector<var>{s[0]};
+        },
+        energy, 3, 1);
+    ASSERT_THROW(shrinking.gradient(x0, theta), std::invalid_argument);
+}
@@ -0,0 +1,31 @@
+#include <fstream>
+#include <iostream>
+
+#include "codegen.hpp"
+#include "codegen_model.hpp"
+
+using namespace autodiff;
+using namespace base;
+
+// Writes the C++ of the model, built once as a tree and once on a tape,
+// to the file named by the first argument.
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: codegen_model <output.cpp>\n";
+        return 1;
+    }
+    std::ofstream out(argv[1]);
+    {
+        std::vector<var> x{var(0.5), var(1.5), var(2.0)};
+        var y = codegen_model(x);
+        out << codegen::generate(y, x, "codegen_model_tree");
+    }
+    {
+        tape t;
+        tape::recording r(t);
+        std::vector<var> x{var(0.5), var(1.5), var(2.0)};
+        var y = codegen_model(x);
+        out << codegen::generate(y, x, "codegen_model_tape");
+    }
+    return out ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "var.hpp"
+
+// The model that codegen_model compiles ahead of time and codegen_test
+// checks against base::gradient; it uses every operation.
+inline autodiff::base::var codegen_model(
+    std::vector<autodiff::base::var>& x) {
+    using namespace autodiff;
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+    auto s = x[0] * x[1] - x[2] * 0.25;
+    auto e = exp_(s) * sin_(x[0]);
+    auto c = cos_(x[1] * x[2]) / (x[0] + 2.0);
+    auto l = ln_(x[0] + 4.0) + log_(x[2] * x[2] + 1.0);
+    auto p = pow_(x[1], x[2]);
+    return -(e + c) * l + p * s;
+}
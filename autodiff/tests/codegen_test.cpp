@@ -0,0 +1,77 @@
+#include "codegen.hpp"
+#include "codegen_model.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+// built into the codegen_model_generated library
+extern "C" double codegen_model_tree(const double* x, double* g);
+extern "C" double codegen_model_tape(const double* x, double* g);
+
+TEST(codegen, compiled_model_matches_gradient) {
+    const std::vector<std::vector<double>> points = {
+        {0.5, 1.5, 2.0}, {1.25, 0.75, 3.5}, {-0.5, 2.0, 0.25}};
+    for (const auto& point : points) {
+        std::vector<var> x;
+        for (double p : point) x.emplace_back(p);
+        var y = codegen_model(x);
+        auto G = gradient(y);
+
+        for (auto f : {codegen_model_tree, codegen_model_tape}) {
+            double g[3];
+            ASSERT_DOUBLE_EQ(f(point.data(), g), y.value());
+            for (std::size_t i = 0; i < 3; ++i) {
+                ASSERT_DOUBLE_EQ(g[i], G[x[i]]);
+            }
+        }
+    }
+}
+
+TEST(codegen, tree_and_tape_lower_alike) {
+    std::vector<var> x{var(0.5), var(1.5), var(2.0)};
+    var y = codegen_model(x);
+    auto tree = codegen::lower(y, x);
+
+    tape t;
+    tape::recording r(t);
+    std::vector<var> z{var(0.5), var(1.5), var(2.0)};
+    var w = codegen_model(z);
+    auto taped = codegen::lower(w, z);
+
+    ASSERT_EQ(tree.records.size(), taped.records.size());
+    ASSERT_EQ(tree.head, tree.records.size() - 1);
+    ASSERT_EQ(taped.head, taped.records.size() - 1);
+    for (std::size_t i = 0; i < 3; ++i) {
+        ASSERT_NE(tree.inputs[i], codegen::program::none);
+        ASSERT_NE(taped.inputs[i], codegen::program::none);
+    }
+}
+
+TEST(codegen, unused_inputs_get_zero) {
+    var a(2);
+    var b(3);
+    var y = a * 0.5;
+    std::vector<var> inputs{a, b};
+    auto p = codegen::lower(y, inputs);
+    ASSERT_EQ(p.inputs[1], codegen::program::none);
+    auto s = codegen::emit(p, "f");
+    ASSERT_NE(s.find("extern \"C\" double f(const double* x, double* g)"),
+              std::string::npos);
+    ASSERT_NE(s.find("g[1] = 0.0;"), std::string::npos);
+    // constants are spelled exactly
+    ASSERT_NE(s.find("0x1p-1"), std::string::npos);
+}
+
+TEST(codegen, other_leaves_are_baked_in) {
+    var a(2);
+    var b(3);
+    var y = a * b;
+    auto s = codegen::generate(y, {a}, "f");
+    ASSERT_NE(s.find("0x1.8p+1"), std::string::npos);
+    ASSERT_EQ(s.find("x[1]"), std::string::npos);
+}
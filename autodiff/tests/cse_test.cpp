@@ -0,0 +1,156 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace autodiff;
+using namespace base;
+
+TEST(cse, shares_repeated_subexpressions) {
+    cse table;
+    cse::scope s(table);
+    auto exp_ = functions::exp();
+    var a(0.5);
+    var b(2);
+    auto y = exp_(a * b) + exp_(a * b);
+    ASSERT_EQ(y.left(), y.right());
+    // a, b, a * b, exp, +
+    ASSERT_EQ(y.topological_order().size(), 5);
+    ASSERT_DOUBLE_EQ(y.value(), 2 * std::exp(1.0));
+
+    auto Y = gradient(y);
+    ASSERT_DOUBLE_EQ(Y[a], 2 * b.value() * std::exp(1.0));
+    ASSERT_DOUBLE_EQ(Y[b], 2 * a.value() * std::exp(1.0));
+}
+
+TEST(cse, commutative_operands_coincide) {
+    cse table;
+    cse::scope s(table);
+    var a(3);
+    var b(4);
+    auto p = a * b;
+    auto q = b * a;
+    ASSERT_EQ(p.node(), q.node());
+    auto r = a + b;
+    auto t = b + a;
+    ASSERT_EQ(r.node(), t.node());
+    auto u = a - b;
+    auto v = b - a;
+    ASSERT_NE(u.node(), v.node());
+}
+
+TEST(cse, shares_constants) {
+    cse table;
+    cse::scope s(table);
+    var a(3);
+    auto p = a * 2.0;
+    auto q = a * 2.0;
+    auto r = a * 3.0;
+    ASSERT_EQ(p.node(), q.node());
+    ASSERT_NE(p.node(), r.node());
+    ASSERT_EQ(p.right(), q.right());
+}
+
+TEST(cse, off_without_a_table) {
+    var a(3);
+    var b(4);
+    auto p = a * b;
+    auto q = a * b;
+    ASSERT_NE(p.node(), q.node());
+    ASSERT_EQ(cse::active(), nullptr);
+}
+
+TEST(cse, scope_restores_previous_table) {
+    cse outer;
+    cse inner;
+    {
+        cse::scope s(outer);
+        ASSERT_EQ(cse::active(), &outer);
+        {
+            cse::scope t(inner);
+            ASSERT_EQ(cse::active(), &inner);
+        }
+        ASSERT_EQ(cse::active(), &outer);
+    }
+    ASSERT_EQ(cse::active(), nullptr);
+}
+
+TEST(cse, does_not_return_dead_nodes) {
+    cse table;
+    cse::scope s(table);
+    var a(3);
+    var b(4);
+    { auto p = a * b; }
+    auto q = a * b;
+    ASSERT_DOUBLE_EQ(q.value(), 12);
+    auto Q = gradient(q);
+    ASSERT_DOUBLE_EQ(Q[a], 4);
+    table.clear();
+    ASSERT_EQ(table.size(), 0);
+}
+
+TEST(cse, shares_records_on_tape) {
+    auto exp_ = functions::exp();
+    tape plain;
+    {
+        tape::recording r(plain);
+        var a(0.5);
+        var b(2);
+        auto y = exp_(a * b) * 3.0 + exp_(b * a) * 3.0;
+    }
+
+    tape t;
+    t.share();
+    ASSERT_TRUE(t.sharing());
+    tape::recording r(t);
+    var a(0.5);
+    var b(2);
+    auto y = exp_(a * b) * 3.0 + exp_(b * a) * 3.0;
+    // a, b, a * b, exp, 3, *, +
+    ASSERT_EQ(t.size(), 7);
+    ASSERT_LT(t.size(), plain.size());
+    ASSERT_DOUBLE_EQ(y.value(), 6 * std::exp(1.0));
+
+    auto Y = gradient(y);
+    ASSERT_DOUBLE_EQ(Y[a], 6 * b.value() * std::exp(1.0));
+    ASSERT_DOUBLE_EQ(Y[b], 6 * a.value() * std::exp(1.0));
+}
+
+TEST(cse, sharing_survives_simplify) {
+    tape t;
+    t.share();
+    tape::recording r(t);
+    var a(2);
+    var b(5);
+    auto p = (a + 0.0) * b;
+    t.simplify(p.get_index());
+    auto q = a * b;
+    ASSERT_EQ(t.position(q.get_index()), t.position(p.get_index()));
+    auto Q = gradient(q);
+    ASSERT_DOUBLE_EQ(Q[a], 5);
+    ASSERT_DOUBLE_EQ(Q[b], 2);
+}
+
+TEST(cse, refused_inside_an_arena) {
+    var a(2);
+    var b(3);
+    cse table;
+    arena region;
+    {
+        cse::scope s(table);
+        arena::scope r(region);
+        ASSERT_THROW(a * b, std::logic_error);
+        ASSERT_THROW(a + 1.0, std::logic_error);
+    }
+    ASSERT_EQ(table.size(), 0);
+    {
+        arena::scope r(region);
+        auto y = a * b + a;
+        ASSERT_EQ(gradient(y)[a], 4);
+    }
+    region.reset();
+    cse::scope s(table);
+    auto y = a * b + a * b;
+    ASSERT_EQ(gradient(y)[a], 6);
+}
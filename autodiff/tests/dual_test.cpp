@@ -0,0 +1,177 @@
+#include "dual.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+using forward::dual;
+
+TEST(dual, arithmetic) {
+    dual<double> x(3, 1);
+    dual<double> y(4);
+
+    auto a = x + y;
+    ASSERT_EQ(a.value(), 7);
+    ASSERT_EQ(a.tangent(), 1);
+
+    auto b = x * y - x / y;
+    ASSERT_EQ(b.value(), 12 - 0.75);
+    ASSERT_EQ(b.tangent(), 4 - 0.25);
+
+    auto c = 1 - x * x + 2 * x;
+    ASSERT_EQ(c.value(), -2);
+    ASSERT_EQ(c.tangent(), -4);
+
+    auto d = -(2 / x);
+    ASSERT_NEAR(d.tangent(), 2.0 / 9, 1e-15);
+}
+
+TEST(dual, functions) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+
+    dual<double> a(2, 1);
+    ASSERT_NEAR(exp_(a * a).tangent(), 218.39, 0.1);
+    ASSERT_NEAR(sin_(a * a).tangent(), -2.61457, 0.001);
+    ASSERT_NEAR(cos_(a * a).tangent(), 3.0272, 0.001);
+    ASSERT_NEAR(ln_(a * a).tangent(), 1.0, 0.001);
+    ASSERT_NEAR(log_(a * a).tangent(), 1.44269504, 0.001);
+
+    dual<double> x(3, 1);
+    dual<double> y(4);
+    ASSERT_NEAR(pow_(x, y).tangent(), 108.0, 0.01);
+    x.set_tangent(0);
+    y.set_tangent(1);
+    ASSERT_NEAR(pow_(x, y).tangent(), 88.9876, 0.01);
+    ASSERT_NEAR(forward::pow(x, 2.0).value(), 9, 1e-12);
+    ASSERT_NEAR(forward::pow(2.0, y).tangent(), 16 * std::log(2.0), 1e-12);
+}
+
+template <typename T>
+T model(const T& x, const T& y) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    return y / (y + exp_(-x)) + sin_(x * y) * x;
+}
+
+TEST(dual, matches_gradient) {
+    base::var x(2);
+    base::var y(1);
+    auto z = model(x, y);
+    auto Z = base::gradient(z);
+
+    auto dx = model(dual<double>(2, 1), dual<double>(1, 0));
+    auto dy = model(dual<double>(2, 0), dual<double>(1, 1));
+    ASSERT_NEAR(dx.value(), z.value(), 1e-12);
+    ASSERT_NEAR(dx.tangent(), Z[x], 1e-12);
+    ASSERT_NEAR(dy.tangent(), Z[y], 1e-12);
+}
+
+TEST(dual, nested_second_derivative) {
+    using dual2 = dual<dual<double>>;
+    dual2 x(dual<double>(0.5, 1), dual<double>(1, 0));
+    auto y = forward::sin(x) * x;
+    // d/dx (x sin x) = sin x + x cos x
+    // d2/dx2 = 2 cos x - x sin x
+    ASSERT_NEAR(y.tangent().value(), std::sin(0.5) + 0.5 * std::cos(0.5),
+                1e-12);
+    ASSERT_NEAR(y.tangent().tangent(), 2 * std::cos(0.5) - 0.5 * std::sin(0.5),
+                1e-12);
+
+    auto l = forward::ln(x * x);
+    ASSERT_NEAR(l.tangent().value(), 2 / 0.5, 1e-12);
+    ASSERT_NEAR(l.tangent().tangent(), -2 / 0.25, 1e-12);
+}
+
+TEST(dual, pow_at_non_positive_base) {
+    auto pow_ = functions::pow();
+    // a constant exponent has no ln(x) term to contribute
+    auto a = forward::pow(dual<double>(-2, 1), dual<double>(2));
+    ASSERT_EQ(a.value(), 4);
+    ASSERT_EQ(a.tangent(), -4);
+    auto b = forward::pow(dual<double>(0, 1), dual<double>(2));
+    ASSERT_EQ(b.value(), 0);
+    ASSERT_EQ(b.tangent(), 0);
+    ASSERT_EQ(forward::pow(-2.0, dual<double>(2)).tangent(), 0);
+
+    base::var x(-2);
+    base::var e(2);
+    auto y = pow_(x, e);
+    auto Y = base::gradient(y);
+    ASSERT_EQ(a.tangent(), Y[x]);
+}
+
+TEST(lanes, arithmetic) {
+    forward::lanes<double, 4> a(2);
+    a[1] = 3;
+    auto b = -(a + a * 2.0 - a / 2.0);
+    ASSERT_EQ(b[0], -5);
+    ASSERT_EQ(b[1], -7.5);
+    ASSERT_EQ(b.size(), 4);
+}
+
+template <typename T>
+T rosenbrock(const std::vector<T>& x) {
+    T s(0);
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        T a = x[i + 1] - x[i] * x[i];
+        T b = 1 - x[i];
+        s = s + 100 * a * a + b * b;
+    }
+    return s;
+}
+
+TEST(lanes, full_gradient_in_one_pass) {
+    constexpr std::size_t n = 8;
+    std::vector<base::var> x;
+    std::vector<forward::dual_n<double, n>> d;
+    for (std::size_t i = 0; i < n; ++i) {
+        x.emplace_back(0.1 * i - 0.3);
+        d.push_back(forward::seed<n>(0.1 * i - 0.3, i));
+    }
+    auto y = rosenbrock(x);
+    auto Y = base::gradient(y);
+    auto dy = rosenbrock(d);
+    ASSERT_NEAR(dy.value(), y.value(), 1e-12);
+    for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(dy.tangent()[i], Y[x[i]], 1e-10);
+    }
+}
+
+TEST(lanes, functions) {
+    auto pow_ = functions::pow();
+    auto x = forward::seed<2>(0.7, 0);
+    auto y = forward::seed<2>(1.3, 1);
+    auto z = model(x, y) + pow_(x, y) + forward::cos(x) * forward::ln(y) +
+             forward::log(x);
+
+    auto dx = model(dual<double>(0.7, 1), dual<double>(1.3, 0)) +
+              forward::pow(dual<double>(0.7, 1), dual<double>(1.3, 0)) +
+              forward::cos(dual<double>(0.7, 1)) * std::log(1.3) +
+              forward::log(dual<double>(0.7, 1));
+    auto dy = model(dual<double>(0.7, 0), dual<double>(1.3, 1)) +
+              forward::pow(dual<double>(0.7, 0), dual<double>(1.3, 1)) +
+              std::cos(0.7) * forward::ln(dual<double>(1.3, 1)) +
+              std::log2(0.7);
+    ASSERT_NEAR(z.value(), dx.value(), 1e-12);
+    ASSERT_NEAR(z.tangent()[0], dx.tangent(), 1e-12);
+    ASSERT_NEAR(z.tangent()[1], dy.tangent(), 1e-12);
+}
+
+TEST(lanes, pow_at_non_positive_base) {
+    // lane 0 moves the base only, lane 1 the exponent only
+    auto x = forward::seed<2>(-2.0, 0);
+    auto y = forward::seed<2>(2.0, 1);
+    auto z = forward::pow(x, y);
+    ASSERT_EQ(z.tangent()[0], -4);
+    ASSERT_TRUE(std::isnan(z.tangent()[1]));
+
+    auto w = forward::pow(forward::seed<2>(0.0, 0), forward::seed<2>(2.0, 1));
+    ASSERT_EQ(w.tangent()[0], 0);
+}
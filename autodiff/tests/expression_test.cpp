@@ -0,0 +1,64 @@
+#include "expression.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+using namespace autodiff;
+namespace ex = autodiff::expression;
+
+TEST(expression, simple) {
+    ex::arg<0> c;
+    ex::arg<1> d;
+    auto f = (c + d) * d;
+    static_assert(decltype(f)::arity == 2, "two inputs");
+    auto r = ex::evaluate(f, {2, 5});
+    ASSERT_EQ(r.value, 35);
+    ASSERT_EQ(r.gradient[0], 5);
+    ASSERT_EQ(r.gradient[1], 12);
+    ASSERT_EQ(ex::value(f, {1, 1}), 2);
+}
+
+TEST(expression, constants) {
+    ex::arg<0> x;
+    auto f = 1 - x * 2.0 + 3.0 / x - x / 4.0 + (x + 1.0) * (2.0 + x) +
+             (5.0 - x) - (x - 1.0) + -x;
+    auto r = ex::evaluate(f, {2});
+    ASSERT_NEAR(r.value, 1 - 4 + 1.5 - 0.5 + 12 + 3 - 1 - 2, 1e-12);
+    ASSERT_NEAR(r.gradient[0], -2 - 0.75 - 0.25 + 7 - 1 - 1 - 1, 1e-12);
+}
+
+TEST(expression, matches_gradient) {
+    auto exp_ = functions::exp();
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+
+    ex::arg<0> a;
+    ex::arg<1> b;
+    auto f = exp_(a * b) + sin_(a) * cos_(b) - ln_(a + b) / log_(b) +
+             pow_(a, b) + ex::pow(a, 2.0) + ex::pow(2.0, b);
+    auto r = ex::evaluate(f, {0.7, 1.3});
+
+    base::var x(0.7);
+    base::var y(1.3);
+    base::var two(2.0);
+    auto g = exp_(x * y) + sin_(x) * cos_(y) - ln_(x + y) / log_(y) +
+             pow_(x, y) + pow_(x, two) + pow_(two, y);
+    auto G = base::gradient(g);
+    ASSERT_NEAR(r.value, g.value(), 1e-12);
+    ASSERT_NEAR(r.gradient[0], G[x], 1e-12);
+    ASSERT_NEAR(r.gradient[1], G[y], 1e-12);
+}
+
+TEST(expression, unused_inputs) {
+    ex::arg<2> z;
+    auto f = ex::exp(z);
+    auto r = ex::evaluate(f, {4, 5, 0});
+    ASSERT_EQ(r.value, 1);
+    ASSERT_EQ(r.gradient[0], 0);
+    ASSERT_EQ(r.gradient[1], 0);
+    ASSERT_EQ(r.gradient[2], 1);
+}
@@ -6,6 +6,7 @@
 #include <string>
 #include <type_traits>
 #include <typeinfo>
+#include <vector>
 
 using namespace autodiff;
 using namespace base;
@@ -93,6 +94,15 @@ TEST(functions, sin) {
     ASSERT_NEAR(C[a], -2.61457, 0.001);
 }
 
+TEST(functions, sin_chain) {
+    var x(0.5);
+    auto sin_ = autodiff::functions::sin();
+    auto cos_ = autodiff::functions::cos();
+    auto y = sin_(x) * 3 + cos_(x) * 2;
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], 3 * std::cos(0.5) - 2 * std::sin(0.5), 1e-12);
+}
+
 TEST(functions, cos) {
     var a(2);
     auto cos_ = autodiff::functions::cos();
@@ -457,3 +467,223 @@ TEST(compound_functions, sin_polynomial) {
     ASSERT_NEAR(Z[x], 5.444, 0.01);
 }
 
+TEST(identity, copies_share_variable) {
+    var a(3);
+    var b = a;
+    auto y = a * b;
+    auto Y = gradient(y);
+    ASSERT_EQ(Y[a], 6);
+    ASSERT_EQ(Y[b], 6);
+
+    set_value(b, 4);
+    y.forward_pass();
+    Y = gradient(y);
+    ASSERT_EQ(y.value(), 16);
+    ASSERT_EQ(Y[a], 8);
+}
+
+TEST(identity, bookkeeping_released_with_graph) {
+    var x(2);
+    var y(3);
+    auto exp_ = autodiff::functions::exp();
+    for (int i = 0; i < 1000; ++i) {
+        auto z = exp_(x * y) + x;
+        auto Z = gradient(z);
+        ASSERT_NEAR(Z[x], 3 * std::exp(6.0) + 1, 1e-6);
+        ASSERT_NEAR(Z[y], 2 * std::exp(6.0), 1e-6);
+    }
+    // only x itself and the handle below still hold x's node
+    ASSERT_EQ(x.node().use_count(), 2);
+}
+
+TEST(dag, shared_subexpression) {
+    var a(10);
+    var b(10);
+    auto s = a + b;
+    auto z = s * s;
+    ASSERT_EQ(z.left(), z.right());
+    ASSERT_EQ(z.topological_order().size(), 4);
+    auto Z = gradient(z);
+    ASSERT_EQ(Z[a], 40);
+    ASSERT_EQ(Z[b], 40);
+}
+
+TEST(dag, deep_reuse_is_linear) {
+    var a(1.5);
+    var s = a;
+    for (int i = 0; i < 60; ++i) {
+        s = s + s;
+    }
+    ASSERT_EQ(s.topological_order().size(), 61);
+    ASSERT_EQ(s.value(), std::ldexp(1.5, 60));
+    auto S = gradient(s);
+    ASSERT_EQ(S[a], std::ldexp(1.0, 60));
+
+    set_value(a, 3);
+    s.forward_pass();
+    ASSERT_EQ(s.value(), std::ldexp(3.0, 60));
+}
+
+TEST(dag, shared_functions) {
+    var a(2);
+    var b(3);
+    auto exp_ = autodiff::functions::exp();
+    auto e = exp_(a * b);
+    auto f = e * e + e;
+    auto F = gradient(f);
+    double v = std::exp(6.0);
+    ASSERT_NEAR(F[a], (2 * v * v + v) * 3, 1e-3);
+    ASSERT_NEAR(F[b], (2 * v * v + v) * 2, 1e-3);
+}
+
+// x = x * c + d for half a million steps: 10^6 operations in one chain,
+// which used to overflow the native stack in every recursive pass.
+TEST(deep, million_operation_chain) {
+    const int steps = 500000;
+    var x(1);
+    var c(0.999999);
+    var d(1e-6);
+    var y = x;
+    for (int i = 0; i < steps; ++i) {
+        y = y * c + d;
+    }
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], std::pow(0.999999, steps), 1e-9);
+    ASSERT_GT(Y[c], 0);
+
+    set_value(x, 2);
+    double cn = std::pow(0.999999, steps);
+    ASSERT_NEAR(y.forward_pass(), 2 * cn + (1 - cn), 1e-6);
+    y.clean_grad();
+    y.set_gradient(1.0);
+    y.grad();
+    ASSERT_NEAR(x.node()->get_gradient(), cn, 1e-9);
+}
+
+TEST(deep, million_operation_chain_on_tape) {
+    tape t;
+    tape::recording r(t);
+    const int steps = 500000;
+    var x(1);
+    var c(0.999999);
+    var d(1e-6);
+    var y = x;
+    for (int i = 0; i < steps; ++i) {
+        y = y * c + d;
+    }
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], std::pow(0.999999, steps), 1e-9);
+}
+
+TEST(fused, chains_become_one_node) {
+    var a(2);
+    var b(3);
+    var c(5);
+    auto p = a * a * a * a;
+    ASSERT_EQ(p.arity(), 4);
+    ASSERT_FALSE(p.left());
+    ASSERT_EQ(p.value(), 16);
+    auto s = a + b + c + a;
+    ASSERT_EQ(s.arity(), 4);
+    ASSERT_EQ(s.value(), 12);
+    // two operands stay a binary node
+    auto t = a + b;
+    ASSERT_EQ(t.arity(), 0);
+    ASSERT_TRUE(t.left());
+    ASSERT_EQ(s.topological_order().size(), 4);
+}
+
+TEST(fused, branches_keep_their_prefix) {
+    var a(1);
+    var b(2);
+    var c(3);
+    var d(4);
+    auto s = a + b + c;
+    auto u = s + d;
+    auto v = s + a;
+    auto w = u + b;
+    ASSERT_EQ(s.value(), 6);
+    ASSERT_EQ(u.value(), 10);
+    ASSERT_EQ(v.value(), 7);
+    ASSERT_EQ(w.value(), 12);
+    auto S = gradient(s);
+    ASSERT_EQ(S[d], 0);
+    auto V = gradient(v);
+    ASSERT_EQ(V[a], 2);
+    ASSERT_EQ(V[d], 0);
+    auto W = gradient(w);
+    ASSERT_EQ(W[b], 2);
+    ASSERT_EQ(W[d], 1);
+}
+
+TEST(fused, product_with_zero_term) {
+    var a(0);
+    var b(3);
+    var c(4);
+    auto p = a * b * c * b;
+    auto P = gradient(p);
+    ASSERT_EQ(P[a], 36);
+    ASSERT_EQ(P[b], 0);
+    ASSERT_EQ(P[c], 0);
+
+    set_value(a, 2);
+    ASSERT_EQ(p.forward_pass(), 72);
+    P = gradient(p);
+    ASSERT_EQ(P[a], 36);
+    ASSERT_EQ(P[b], 48);
+    ASSERT_EQ(P[c], 18);
+}
+
+TEST(fused, long_accumulation) {
+    const int n = 100000;
+    std::vector<var> x;
+    for (int i = 0; i < n; ++i) x.emplace_back(i * 1e-3);
+    var sum = x[0];
+    for (int i = 1; i < n; ++i) sum = sum + x[i] * x[i];
+    ASSERT_EQ(sum.arity(), n);
+    auto S = gradient(sum);
+    ASSERT_EQ(S[x[0]], 1);
+    ASSERT_DOUBLE_EQ(S[x[n - 1]], 2 * (n - 1) * 1e-3);
+
+    set_value(x[1], 10);
+    double before = sum.value();
+    ASSERT_DOUBLE_EQ(sum.forward_pass(), before - 1e-6 + 100);
+}
+
+TEST(fused, self_reuse_is_released) {
+    std::weak_ptr<var> first;
+    std::weak_ptr<var> head;
+    {
+        var a(1.5);
+        var s = a + a + a;
+        first = s.node();
+        for (int i = 0; i < 60; ++i) s = s + s;
+        // the sum of three, then one binary node per doubling
+        ASSERT_EQ(s.topological_order().size(), 62);
+        auto S = gradient(s);
+        ASSERT_EQ(S[a], std::ldexp(3.0, 60));
+        head = s.node();
+    }
+    ASSERT_TRUE(first.expired());
+    ASSERT_TRUE(head.expired());
+}
+
+TEST(fused, euler_steps_stay_linear) {
+    const int n = 20000;
+    std::weak_ptr<var> first;
+    std::weak_ptr<var> head;
+    {
+        var y0(1);
+        var c(1e-4);
+        var y = y0 + c + y0;
+        first = y.node();
+        for (int i = 0; i < n; ++i) y = y + y * c;
+        // y0, c, the first sum, then an add and a mul per step
+        ASSERT_EQ(y.topological_order().size(), 3 + 2 * n);
+        auto Y = gradient(y);
+        ASSERT_NEAR(Y[y0], 2 * std::pow(1 + 1e-4, n), 1e-9);
+        head = y.node();
+    }
+    ASSERT_TRUE(first.expired());
+    ASSERT_TRUE(head.expired());
+}
@@ -0,0 +1,143 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+#include "hessian.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// f(x, y) = x y^2 + sin(x) exp(y) + x / y + x^y + ln(x) log(y) + cos(x y)
+var model(std::vector<var>& v) {
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto exp_ = functions::exp();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+    var& x = v[0];
+    var& y = v[1];
+    return x * y * y + sin_(x) * exp_(y) + x / y + pow_(x, y) +
+           ln_(x) * log_(y) + cos_(x * y);
+}
+
+// The same second derivatives worked out by hand.
+void analytic(double x, double y, double h[4]) {
+    const double l2 = std::log(2.0);
+    const double p = std::pow(x, y);
+    h[0] = -std::sin(x) * std::exp(y) + y * (y - 1) * std::pow(x, y - 2) -
+           std::log(y) / (l2 * x * x) - y * y * std::cos(x * y);
+    h[1] = 2 * y + std::cos(x) * std::exp(y) - 1 / (y * y) +
+           std::pow(x, y - 1) * (1 + y * std::log(x)) + 1 / (x * y * l2) -
+           std::sin(x * y) - x * y * std::cos(x * y);
+    h[2] = h[1];
+    h[3] = 2 * x + std::sin(x) * std::exp(y) + 2 * x / (y * y * y) +
+           p * std::log(x) * std::log(x) - std::log(x) / (y * y * l2) -
+           x * x * std::cos(x * y);
+}
+
+void expect_analytic(hessian& H, double x, double y) {
+    double expected[4];
+    analytic(x, y, expected);
+    auto h = H.matrix();
+    for (int k = 0; k < 4; ++k) ASSERT_NEAR(h[k], expected[k], 1e-10) << k;
+}
+
+}  // namespace
+
+TEST(hessian, tree_matches_analytic) {
+    std::vector<var> v{var(1.5), var(0.75)};
+    var f = model(v);
+    hessian H(f, v);
+    ASSERT_EQ(H.size(), 2);
+    expect_analytic(H, 1.5, 0.75);
+}
+
+TEST(hessian, tape_matches_analytic) {
+    tape t;
+    tape::recording r(t);
+    std::vector<var> v{var(1.5), var(0.75)};
+    var f = model(v);
+    {
+        hessian H(f, v);
+        expect_analytic(H, 1.5, 0.75);
+    }
+    set_value(v[0], 0.5);
+    set_value(v[1], 2.0);
+    f.forward_pass();
+    hessian H(f, v);
+    expect_analytic(H, 0.5, 2.0);
+}
+
+TEST(hessian, product_gives_gradient_too) {
+    std::vector<var> v{var(1.5), var(0.75)};
+    var f = model(v);
+    hessian H(f, v);
+    auto G = gradient(f);
+    double d[2] = {0.3, -1.2};
+    double hv[2];
+    double g[2];
+    H.product(d, hv, g);
+    ASSERT_DOUBLE_EQ(g[0], G[v[0]]);
+    ASSERT_DOUBLE_EQ(g[1], G[v[1]]);
+    auto h = H.matrix();
+    ASSERT_NEAR(hv[0], h[0] * d[0] + h[1] * d[1], 1e-12);
+    ASSERT_NEAR(hv[1], h[2] * d[0] + h[3] * d[1], 1e-12);
+}
+
+TEST(hessian, quadratic_form) {
+    // f = x^T A x / 2 with a symmetric A has Hessian A
+    std::vector<var> x{var(1), var(2), var(3)};
+    const double A[3][3] = {{2, 1, 0}, {1, 3, -1}, {0, -1, 4}};
+    var f = x[0] * 0.0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) f = f + x[i] * x[j] * (A[i][j] / 2);
+    }
+    hessian H(f, x);
+    auto h = H.matrix();
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) ASSERT_DOUBLE_EQ(h[i * 3 + j], A[i][j]);
+    }
+    auto hv = H.product({1, 0, -1});
+    ASSERT_DOUBLE_EQ(hv[0], 2);
+    ASSERT_DOUBLE_EQ(hv[1], 2);
+    ASSERT_DOUBLE_EQ(hv[2], -4);
+}
+
+TEST(hessian, inputs_outside_the_graph) {
+    var a(2);
+    var b(3);
+    var f = a * a * a;
+    hessian H(f, {a, b});
+    auto h = H.matrix();
+    ASSERT_DOUBLE_EQ(h[0], 12);
+    ASSERT_DOUBLE_EQ(h[1], 0);
+    ASSERT_DOUBLE_EQ(h[2], 0);
+    ASSERT_DOUBLE_EQ(h[3], 0);
+    ASSERT_THROW(H.product({1.0}), std::invalid_argument);
+}
+
+TEST(hessian, constant_exponent_of_a_negative_base) {
+    // log(x) is NaN for x < 0, and must stay out of d/dx x^2
+    auto pow_ = functions::pow();
+    var x(-1.5);
+    var y(2);
+    var e(2);
+    var f = y * pow_(x, e);
+    hessian H(f, {x, y});
+    auto h = H.matrix();
+    ASSERT_DOUBLE_EQ(h[0], 4);
+    ASSERT_DOUBLE_EQ(h[1], -3);
+    ASSERT_DOUBLE_EQ(h[2], -3);
+    ASSERT_DOUBLE_EQ(h[3], 0);
+    std::vector<double> g(2);
+    std::vector<double> hv(2);
+    H.product(std::vector<double>{1, 1}.data(), hv.data(), g.data());
+    ASSERT_DOUBLE_EQ(g[0], -6);
+    ASSERT_DOUBLE_EQ(g[1], 2.25);
+    ASSERT_DOUBLE_EQ(hv[0], 1);
+    ASSERT_DOUBLE_EQ(hv[1], -3);
+}
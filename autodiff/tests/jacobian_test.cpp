@@ -0,0 +1,146 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+#include "jacobian.hpp"
+
+#include <cmath>
+#include <optional>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// f(a, b, c) = (a * b, sin(a) + c / b, exp(c), 3)
+std::vector<var> model(std::vector<var>& x) {
+    auto sin_ = functions::sin();
+    auto exp_ = functions::exp();
+    return {x[0] * x[1], sin_(x[0]) + x[2] / x[1], exp_(x[2]), var(3.0) * 1.0};
+}
+
+void expect_analytic(const jacobian& J, double a, double b, double c) {
+    ASSERT_EQ(J.rows(), 4);
+    ASSERT_EQ(J.cols(), 3);
+    const double expected[4][3] = {{b, a, 0},
+                                   {std::cos(a), -c / (b * b), 1 / b},
+                                   {0, 0, std::exp(c)},
+                                   {0, 0, 0}};
+    for (std::size_t i = 0; i < 4; ++i) {
+        for (std::size_t j = 0; j < 3; ++j) {
+            ASSERT_DOUBLE_EQ(J(i, j), expected[i][j]) << i << ", " << j;
+        }
+    }
+}
+
+}  // namespace
+
+TEST(jacobian, tree_both_directions) {
+    std::vector<var> x{var(0.5), var(2.0), var(1.5)};
+    auto y = model(x);
+    jacobian F(y, x, jacobian::mode::forward);
+    jacobian R(y, x, jacobian::mode::reverse);
+    ASSERT_EQ(F.used(), jacobian::mode::forward);
+    ASSERT_EQ(R.used(), jacobian::mode::reverse);
+    expect_analytic(F, 0.5, 2.0, 1.5);
+    expect_analytic(R, 0.5, 2.0, 1.5);
+}
+
+TEST(jacobian, tape_both_directions) {
+    tape t;
+    tape::recording r(t);
+    std::vector<var> x{var(0.5), var(2.0), var(1.5)};
+    auto y = model(x);
+    expect_analytic(jacobian(y, x, jacobian::mode::forward), 0.5, 2.0, 1.5);
+    expect_analytic(jacobian(y, x, jacobian::mode::reverse), 0.5, 2.0, 1.5);
+
+    set_value(x[0], 1.0);
+    for (auto& v : y) v.forward_pass();
+    expect_analytic(jacobian(y, x), 1.0, 2.0, 1.5);
+}
+
+TEST(jacobian, picks_the_cheaper_direction) {
+    std::vector<var> x{var(0.5), var(2.0), var(1.5)};
+    auto y = model(x);
+    ASSERT_EQ(jacobian(y, x).used(), jacobian::mode::forward);
+    std::vector<var> one{y[1]};
+    ASSERT_EQ(jacobian(one, x).used(), jacobian::mode::reverse);
+}
+
+TEST(jacobian, rows_match_gradient) {
+    auto exp_ = functions::exp();
+    std::vector<var> x;
+    for (int i = 0; i < 5; ++i) x.emplace_back(0.1 * (i + 1));
+    var shared = exp_(x[0] * x[1]) + x[2];
+    std::vector<var> y;
+    for (int k = 0; k < 8; ++k) y.push_back(shared * x[k % 5] + x[(k + 1) % 5]);
+    jacobian J(y, x);
+    for (std::size_t k = 0; k < y.size(); ++k) {
+        auto G = gradient(y[k]);
+        for (std::size_t j = 0; j < x.size(); ++j) {
+            ASSERT_DOUBLE_EQ(J(k, j), G[x[j]]);
+        }
+    }
+}
+
+TEST(jacobian, inputs_outside_the_graph) {
+    var a(2);
+    var b(3);
+    var unused(4);
+    std::vector<var> y{a * b};
+    jacobian J(y, {a, unused, b});
+    ASSERT_DOUBLE_EQ(J(0, 0), 3);
+    ASSERT_DOUBLE_EQ(J(0, 1), 0);
+    ASSERT_DOUBLE_EQ(J(0, 2), 2);
+    // an output that is itself an input
+    jacobian I(std::vector<var>{a}, {a, b});
+    ASSERT_DOUBLE_EQ(I(0, 0), 1);
+    ASSERT_DOUBLE_EQ(I(0, 1), 0);
+}
+
+TEST(jacobian, dense_and_sparse_buffers) {
+    std::vector<var> x{var(0.5), var(2.0), var(1.5)};
+    auto y = model(x);
+    jacobian J(y, x);
+
+    std::vector<double> dense(4 * 5, -1);
+    J.dense(dense.data(), 5);
+    for (std::size_t i = 0; i < 4; ++i) {
+        for (std::size_t j = 0; j < 3; ++j) {
+            ASSERT_EQ(dense[i * 5 + j], J(i, j));
+        }
+        ASSERT_EQ(dense[i * 5 + 3], -1);
+    }
+
+    csr S = J.sparse();
+    ASSERT_EQ(S.rows, 4);
+    ASSERT_EQ(S.cols, 3);
+    ASSERT_EQ(S.offsets, (std::vector<std::size_t>{0, 2, 5, 6, 6}));
+    ASSERT_EQ(S.columns, (std::vector<std::size_t>{0, 1, 0, 1, 2, 2}));
+    for (std::size_t i = 0; i < 4; ++i) {
+        for (std::size_t k = S.offsets[i]; k < S.offsets[i + 1]; ++k) {
+            ASSERT_EQ(S.values[k], J(i, S.columns[k]));
+        }
+    }
+}
+
+TEST(jacobian, directions_agree_at_a_negative_base) {
+    auto pow_ = functions::pow();
+    for (bool recorded : {false, true}) {
+        tape t;
+        std::optional<tape::recording> r;
+        if (recorded) r.emplace(t);
+        std::vector<var> x{var(-2.0)};
+        var e(2.0);
+        std::vector<var> y{pow_(x[0], e), x[0] * 3.0};
+        jacobian F(y, x, jacobian::mode::forward);
+        jacobian R(y, x, jacobian::mode::reverse);
+        jacobian A(y, x);
+        ASSERT_EQ(A.used(), jacobian::mode::forward);
+        ASSERT_EQ(F(0, 0), -4);
+        ASSERT_EQ(F(1, 0), 3);
+        for (std::size_t i = 0; i < 2; ++i) {
+            ASSERT_EQ(F(i, 0), R(i, 0));
+            ASSERT_EQ(A(i, 0), R(i, 0));
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#include "codegen_model.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+#include "jit.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// A cache directory of its own, removed afterwards.
+struct directory {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        ("autodiff-jit-test-" + std::to_string(getpid()));
+    ~directory() { std::filesystem::remove_all(path); }
+};
+
+}  // namespace
+
+TEST(jit, kernel_matches_gradient) {
+    directory d;
+    codegen::jit j(d.path);
+    std::vector<var> x{var(0.5), var(1.5), var(2.0)};
+    var y = codegen_model(x);
+    auto k = j.compile(y, x);
+    ASSERT_EQ(k.inputs(), 3);
+
+    const std::vector<std::vector<double>> points = {
+        {0.5, 1.5, 2.0}, {1.25, 0.75, 3.5}, {-0.5, 2.0, 0.25}};
+    for (const auto& point : points) {
+        for (std::size_t i = 0; i < 3; ++i) set_value(x[i], point[i]);
+        y.forward_pass();
+        auto G = gradient(y);
+        std::vector<double> g;
+        ASSERT_DOUBLE_EQ(k(point, g), y.value());
+        for (std::size_t i = 0; i < 3; ++i) ASSERT_DOUBLE_EQ(g[i], G[x[i]]);
+    }
+}
+
+TEST(jit, compiles_a_recorded_graph) {
+    directory d;
+    codegen::jit j(d.path);
+    tape t;
+    tape::recording r(t);
+    std::vector<var> x{var(0.5), var(1.5), var(2.0)};
+    var y = codegen_model(x);
+    auto G = gradient(y);
+    auto k = j.compile(y, x);
+    double g[3];
+    double p[3] = {0.5, 1.5, 2.0};
+    ASSERT_DOUBLE_EQ(k(p, g), y.value());
+    for (std::size_t i = 0; i < 3; ++i) ASSERT_DOUBLE_EQ(g[i], G[x[i]]);
+}
+
+TEST(jit, caches_by_structure) {
+    directory d;
+    codegen::jit j(d.path);
+    auto exp_ = functions::exp();
+    double p[2] = {0.5, 2.0};
+    double g[2];
+    for (double c : {1.0, 2.0, 3.0}) {
+        var a(p[0]);
+        var b(p[1]);
+        var y = exp_(a * c) * b;
+        auto k = j.compile(y, {a, b});
+        ASSERT_DOUBLE_EQ(k(p, g), std::exp(0.5 * c) * 2.0);
+        ASSERT_DOUBLE_EQ(g[0], c * std::exp(0.5 * c) * 2.0);
+        ASSERT_DOUBLE_EQ(g[1], std::exp(0.5 * c));
+    }
+    ASSERT_EQ(j.size(), 1);
+    ASSERT_EQ(j.compilations(), 1);
+
+    var a(1);
+    var b(2);
+    var y = a / b;
+    j.compile(y, {a, b});
+    ASSERT_EQ(j.size(), 2);
+    ASSERT_EQ(j.compilations(), 2);
+
+    // another jit finds the shared objects left in the directory
+    codegen::jit other(d.path);
+    other.compile(y, {a, b});
+    ASSERT_EQ(other.compilations(), 0);
+}
+
+TEST(jit, reports_compiler_failure) {
+    directory d;
+    codegen::jit j(d.path);
+    j.set_compiler("autodiff-no-such-compiler");
+    var a(1);
+    var y = a * a;
+    ASSERT_THROW(j.compile(y, {a}), std::runtime_error);
+    ASSERT_EQ(j.size(), 0);
+}
+
+TEST(jit, kernels_outlive_the_jit) {
+    directory d;
+    var a(3);
+    var y = a * a;
+    std::vector<codegen::kernel> kernels;
+    {
+        codegen::jit j(d.path);
+        kernels.push_back(j.compile(y, {a}));
+    }
+    double p[1] = {3};
+    double g[1];
+    ASSERT_DOUBLE_EQ(kernels[0](p, g), 9);
+    ASSERT_DOUBLE_EQ(g[0], 6);
+}
+
+TEST(jit, trusts_only_private_files) {
+    // the default directory is the user's alone
+    codegen::jit mine;
+    struct stat st;
+    ASSERT_EQ(stat(codegen::jit::user_directory().c_str(), &st), 0);
+    ASSERT_EQ(st.st_uid, geteuid());
+    ASSERT_EQ(st.st_mode & 077, 0);
+
+    directory d;
+    var a(3);
+    var y = a * a;
+    {
+        codegen::jit j(d.path);
+        j.compile(y, {a});
+    }
+    // a shared object that others could have replaced is not loaded
+    for (const auto& f : std::filesystem::directory_iterator(d.path)) {
+        if (f.path().extension() == ".so") {
+            chmod(f.path().c_str(), 0666);
+        }
+    }
+    codegen::jit j(d.path);
+    ASSERT_THROW(j.compile(y, {a}), std::runtime_error);
+
+    // nor is anything from a directory others can write to
+    chmod(d.path.c_str(), 0777);
+    ASSERT_THROW(codegen::jit{d.path}, std::runtime_error);
+}
@@ -0,0 +1,66 @@
+#include "pool.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+TEST(pool, runs_every_task_once) {
+    thread_pool pool(4);
+    ASSERT_EQ(pool.size(), 4);
+    for (std::size_t tasks : {0, 1, 3, 1000}) {
+        std::vector<std::atomic<int>> hits(tasks);
+        pool.parallel_for(tasks, [&](std::size_t t, std::size_t w) {
+            ASSERT_LT(w, pool.size());
+            ++hits[t];
+        });
+        for (auto& h : hits) ASSERT_EQ(h, 1);
+    }
+}
+
+TEST(pool, single_worker_runs_inline) {
+    thread_pool pool(1);
+    std::vector<int> order;
+    pool.parallel_for(5, [&](std::size_t t, std::size_t w) {
+        ASSERT_EQ(w, 0);
+        order.push_back(static_cast<int>(t));
+    });
+    ASSERT_EQ(order.size(), 5);
+}
+
+TEST(pool, uneven_tasks_are_stolen) {
+    // worker 0's block is the slow one; the others finish theirs and
+    // steal from it
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> by(pool.size());
+    pool.parallel_for(64, [&](std::size_t t, std::size_t w) {
+        if (t < 16) {
+            volatile double s = 0;
+            for (int i = 0; i < 200000; ++i) s = s + i;
+        }
+        ++by[w];
+    });
+    int total = 0;
+    for (auto& n : by) total += n;
+    ASSERT_EQ(total, 64);
+}
+
+TEST(pool, rethrows_task_errors) {
+    thread_pool pool(3);
+    std::atomic<int> ran{0};
+    ASSERT_THROW(pool.parallel_for(10,
+                                   [&](std::size_t t, std::size_t) {
+                                       ++ran;
+                                       if (t == 4) {
+                                           throw std::runtime_error("boom");
+                                       }
+                                   }),
+                 std::runtime_error);
+    ASSERT_EQ(ran, 10);
+    // still usable afterwards
+    pool.parallel_for(10, [&](std::size_t, std::size_t) { ++ran; });
+    ASSERT_EQ(ran, 20);
+}
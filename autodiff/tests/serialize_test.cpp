@@ -0,0 +1,176 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+#include "serialize.hpp"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// A file of its own, removed afterwards.
+struct file {
+    std::string path = "/tmp/autodiff-serialize-test-" +
+                       std::to_string(getpid()) + ".adg";
+    ~file() { std::remove(path.c_str()); }
+};
+
+// Saves (x * y + sin(x)) / y and exp(x) - 2 with the leaves named x and y.
+void save_model(const std::string& path) {
+    auto sin_ = functions::sin();
+    auto exp_ = functions::exp();
+    tape t;
+    tape::recording r(t);
+    var x(std::string("x"), 0.5);
+    var y(std::string("y"), 2.0);
+    var f = (x * y + sin_(x)) / y;
+    var g = exp_(x) - 2.0;
+    save(path, {f, g}, {x, y});
+}
+
+}  // namespace
+
+TEST(serialize, round_trip) {
+    file f;
+    save_model(f.path);
+
+    image m(f.path);
+    ASSERT_EQ(m.outputs(), 2);
+    var x = m.leaf("x");
+    var y = m.leaf("y");
+    var F = m.output(0);
+    var G = m.output(1);
+    ASSERT_DOUBLE_EQ(x.value(), 0.5);
+    ASSERT_DOUBLE_EQ(F.value(), (0.5 * 2 + std::sin(0.5)) / 2);
+
+    set_value(x, 1.5);
+    set_value(y, 3.0);
+    ASSERT_DOUBLE_EQ(F.forward_pass(), (1.5 * 3 + std::sin(1.5)) / 3);
+    ASSERT_DOUBLE_EQ(G.forward_pass(), std::exp(1.5) - 2);
+    auto dF = gradient(F);
+    ASSERT_DOUBLE_EQ(dF[x], (3 + std::cos(1.5)) / 3);
+    ASSERT_NEAR(dF[y], -std::sin(1.5) / 9, 1e-12);
+    auto dG = gradient(G);
+    ASSERT_DOUBLE_EQ(dG[x], std::exp(1.5));
+    ASSERT_DOUBLE_EQ(dG[y], 0);
+}
+
+TEST(serialize, values_stay_private) {
+    file f;
+    save_model(f.path);
+    {
+        image m(f.path);
+        var x = m.leaf("x");
+        set_value(x, 4.0);
+        m.output(0).forward_pass();
+    }
+    image m(f.path, true);
+    ASSERT_DOUBLE_EQ(m.leaf("x").value(), 0.5);
+}
+
+TEST(serialize, recording_onto_a_loaded_tape) {
+    file f;
+    save_model(f.path);
+    image m(f.path);
+    std::size_t before = m.get_tape().size();
+    tape::recording r(m.get_tape());
+    var x = m.leaf("x");
+    var F = m.output(0);
+    var z = F * x;
+    ASSERT_EQ(m.get_tape().size(), before + 1);
+    auto dz = gradient(z);
+    double f0 = (0.5 * 2 + std::sin(0.5)) / 2;
+    ASSERT_DOUBLE_EQ(dz[x], f0 + 0.5 * (2 + std::cos(0.5)) / 2);
+}
+
+TEST(serialize, simplified_tapes_keep_their_indices) {
+    file f;
+    {
+        tape t;
+        tape::recording r(t);
+        var x(std::string("x"), 2.0);
+        var y = (x + 0.0) * 1.0 * x;
+        t.simplify(y.get_index());
+        save(f.path, {y}, {x});
+    }
+    image m(f.path, true);
+    var x = m.leaf("x");
+    var y = m.output(0);
+    ASSERT_DOUBLE_EQ(y.value(), 4);
+    ASSERT_DOUBLE_EQ(gradient(y)[x], 4);
+}
+
+TEST(serialize, unknown_names) {
+    file f;
+    save_model(f.path);
+    image m(f.path);
+    ASSERT_THROW(m.leaf("z"), std::out_of_range);
+}
+
+TEST(serialize, rejects_bad_files) {
+    file f;
+    ASSERT_THROW(image(f.path), std::runtime_error);
+
+    save_model(f.path);
+    std::string bytes;
+    {
+        std::ifstream in(f.path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    auto write = [&](const std::string& b) {
+        std::ofstream out(f.path, std::ios::binary | std::ios::trunc);
+        out << b;
+    };
+
+    std::string bad = bytes;
+    bad[0] = 'x';
+    write(bad);
+    ASSERT_THROW(image(f.path), std::runtime_error);
+
+    bad = bytes;
+    bad[8] = 2;  // version
+    write(bad);
+    ASSERT_THROW(image(f.path), std::runtime_error);
+
+    write(bytes.substr(0, bytes.size() - 1));
+    ASSERT_THROW(image(f.path), std::runtime_error);
+
+    // the operand of the last record, f, pointing at itself
+    bad = bytes;
+    const std::size_t records = sizeof(format::header);
+    std::uint64_t n;
+    std::memcpy(&n, bytes.data() + 24, sizeof n);
+    record r;
+    std::memcpy(&r, bytes.data() + records + (n - 1) * sizeof r, sizeof r);
+    r.lhs = static_cast<std::uint32_t>(n - 1);
+    std::memcpy(&bad[records + (n - 1) * sizeof r], &r, sizeof r);
+    write(bad);
+    ASSERT_NO_THROW(image(f.path));
+    ASSERT_THROW(image(f.path, true), std::runtime_error);
+}
+
+TEST(serialize, needs_recorded_outputs) {
+    file f;
+    var x(1);
+    ASSERT_THROW(save(f.path, {x * x}), std::logic_error);
+}
+
+TEST(serialize, vars_of_other_tapes) {
+    file f;
+    tape small;
+    tape large;
+    var x(small, 1);
+    var y = x * x;
+    // indices past the end of the small tape
+    var z(large, 2);
+    for (int i = 0; i < 100; ++i) z = z * z;
+    ASSERT_THROW(save(f.path, {y}, {z}), std::logic_error);
+    ASSERT_THROW(save(f.path, {y, z}), std::logic_error);
+}
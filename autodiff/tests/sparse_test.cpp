@@ -0,0 +1,160 @@
+#include "gtest/gtest.h"
+#include "sparse.hpp"
+
+#include <cmath>
+#include <optional>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+// y[i] = x[i-1] x[i] + sin(x[i+1]): three entries per row at most.
+std::vector<var> banded(std::vector<var>& x) {
+    auto sin_ = functions::sin();
+    std::vector<var> y;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        var yi = sin_(x[i]);
+        if (i > 0) yi = yi + x[i - 1] * x[i];
+        if (i + 1 < x.size()) yi = yi + sin_(x[i + 1]);
+        y.push_back(yi);
+    }
+    return y;
+}
+
+std::vector<var> inputs(std::size_t n) {
+    std::vector<var> x;
+    for (std::size_t i = 0; i < n; ++i) x.emplace_back(0.3 + 0.1 * i);
+    return x;
+}
+
+// Every entry of s at its place in the dense d, and nothing else in d.
+void expect_same(const csr& s, const jacobian& d) {
+    std::vector<double> dense(d.rows() * d.cols(), 0.0);
+    for (std::size_t i = 0; i < s.rows; ++i) {
+        for (std::size_t k = s.offsets[i]; k < s.offsets[i + 1]; ++k) {
+            dense[i * d.cols() + s.columns[k]] = s.values[k];
+        }
+    }
+    for (std::size_t k = 0; k < dense.size(); ++k) {
+        ASSERT_NEAR(dense[k], d.data()[k], 1e-12) << k;
+    }
+}
+
+}  // namespace
+
+TEST(sparse, jacobian_of_banded_tree) {
+    auto x = inputs(12);
+    auto y = banded(x);
+    sparse_jacobian J(y, x);
+    ASSERT_EQ(J.colours(), 3);
+    ASSERT_EQ(J.matrix().columns.size(), 12 * 3 - 2);
+    expect_same(J.matrix(), jacobian(y, x));
+}
+
+TEST(sparse, jacobian_of_banded_tape) {
+    tape t;
+    tape::recording r(t);
+    auto x = inputs(12);
+    auto y = banded(x);
+    sparse_jacobian J(y, x);
+    ASSERT_EQ(J.colours(), 3);
+    expect_same(J.matrix(), jacobian(y, x));
+
+    for (std::size_t i = 0; i < x.size(); ++i) set_value(x[i], 1.0 - 0.05 * i);
+    y.back().forward_pass();
+    J.evaluate();
+    expect_same(J.matrix(), jacobian(y, x));
+}
+
+TEST(sparse, dense_row_is_swept_in_reverse) {
+    // one output on every input, the rest on one each: rows colour in two
+    auto x = inputs(8);
+    std::vector<var> y;
+    var total = x[0] * x[0];
+    for (std::size_t i = 1; i < x.size(); ++i) total = total + x[i] * x[i];
+    y.push_back(total);
+    for (std::size_t i = 0; i < x.size(); ++i) y.push_back(x[i] * 3.0);
+    sparse_jacobian J(y, x);
+    ASSERT_FALSE(J.forward());
+    ASSERT_EQ(J.colours(), 2);
+    expect_same(J.matrix(), jacobian(y, x));
+}
+
+TEST(sparse, directions_agree_at_a_negative_base) {
+    // a constant exponent of a negative base: its partial is NaN, but
+    // it has no tangent, so neither sweep may pick it up
+    auto pow_ = functions::pow();
+    for (bool recorded : {false, true}) {
+        tape t;
+        std::optional<tape::recording> r;
+        if (recorded) r.emplace(t);
+        std::vector<var> x{var(-2.0), var(1.5)};
+        var e(2.0);
+        std::vector<var> y{pow_(x[0], e), x[0] * 3.0};
+        sparse_jacobian F(y, {x[0]});
+        ASSERT_TRUE(F.forward());
+        expect_same(F.matrix(), jacobian(y, {x[0]}, jacobian::mode::reverse));
+        ASSERT_EQ(F.matrix().values[0], -4);
+
+        std::vector<var> z{pow_(x[0], e) * x[1]};
+        sparse_jacobian R(z, x);
+        ASSERT_FALSE(R.forward());
+        expect_same(R.matrix(), jacobian(z, x, jacobian::mode::forward));
+        ASSERT_EQ(R.matrix().values[0], -6);
+    }
+}
+
+TEST(sparse, columns) {
+    auto x = inputs(5);
+    auto y = banded(x);
+    sparse_jacobian J(y, x);
+    csc c = J.columns();
+    jacobian d(y, x);
+    ASSERT_EQ(c.offsets.back(), J.matrix().columns.size());
+    for (std::size_t j = 0; j < c.cols; ++j) {
+        for (std::size_t k = c.offsets[j]; k < c.offsets[j + 1]; ++k) {
+            ASSERT_DOUBLE_EQ(c.values[k], d(c.rows_of[k], j));
+        }
+    }
+}
+
+TEST(sparse, hessian_of_chain) {
+    // f = sum exp(x[i] x[i+1]) + ln(x[i]): tridiagonal
+    auto exp_ = functions::exp();
+    auto ln_ = functions::ln();
+    auto x = inputs(10);
+    var f = ln_(x[0]);
+    for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+        var p = x[i] * x[i + 1];
+        f = f + exp_(p) + ln_(x[i + 1]);
+    }
+    sparse_hessian H(f, x);
+    ASSERT_EQ(H.colours(), 3);
+    const csr& m = H.matrix();
+    ASSERT_EQ(m.columns.size(), 10 * 3 - 2);
+
+    hessian full(f, x);
+    auto h = full.matrix();
+    std::vector<double> dense(h.size(), 0.0);
+    for (std::size_t i = 0; i < m.rows; ++i) {
+        for (std::size_t k = m.offsets[i]; k < m.offsets[i + 1]; ++k) {
+            dense[i * 10 + m.columns[k]] = m.values[k];
+        }
+    }
+    for (std::size_t k = 0; k < h.size(); ++k) {
+        ASSERT_NEAR(dense[k], h[k], 1e-12) << k;
+    }
+}
+
+TEST(sparse, linear_parts_have_no_hessian) {
+    auto x = inputs(4);
+    var f = x[0] * 2.0 + x[1] - x[2] + x[3] * x[3];
+    sparse_hessian H(f, x);
+    const csr& m = H.matrix();
+    ASSERT_EQ(m.columns.size(), 1);
+    ASSERT_EQ(m.offsets[3], 0);
+    ASSERT_EQ(m.columns[0], 3);
+    ASSERT_DOUBLE_EQ(m.values[0], 2);
+}
@@ -0,0 +1,272 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace autodiff;
+using namespace base;
+
+TEST(tape, records_operations) {
+    tape t;
+    tape::recording r(t);
+    var c(2);
+    var d(5);
+    auto y = (c + d) * d;
+    ASSERT_EQ(t.size(), 4);
+    ASSERT_EQ(y.get_tape(), &t);
+    ASSERT_EQ(y.get_index(), 3);
+    ASSERT_EQ(y.value(), 35);
+    ASSERT_FALSE(y.left());
+    ASSERT_FALSE(y.right());
+}
+
+TEST(tape, simple_binary_ops) {
+    tape t;
+    tape::recording r(t);
+    var a(10);
+    auto x = -a;
+    auto X = gradient(x);
+    ASSERT_EQ(X[a], -1);
+
+    var c(1);
+    var d(10);
+    auto y = c / d;
+    auto Y = gradient(y);
+    ASSERT_EQ(Y[c], 0.1);
+    ASSERT_EQ(Y[d], -0.01);
+}
+
+TEST(tape, complex_binary_ops) {
+    tape t;
+    tape::recording r(t);
+    var a(10);
+    var b(10);
+    auto x = a * a * a * a + b;
+    auto X = gradient(x);
+    ASSERT_EQ(X[a], 4000);
+    ASSERT_EQ(X[b], 1);
+
+    var c(5);
+    auto w = (a + b) * (a + b) + c * a * b;
+    auto W = gradient(w);
+    ASSERT_EQ(W[a], 90);
+    ASSERT_EQ(W[b], 90);
+    ASSERT_EQ(W[c], 100);
+}
+
+TEST(tape, functions) {
+    tape t;
+    tape::recording r(t);
+    auto exp_ = autodiff::functions::exp();
+    auto sin_ = autodiff::functions::sin();
+    auto cos_ = autodiff::functions::cos();
+    auto ln_ = autodiff::functions::ln();
+    auto log_ = autodiff::functions::log();
+    auto pow_ = autodiff::functions::pow();
+
+    var a(2);
+    var b(3);
+    auto e = exp_(a * b) + exp_(a * b);
+    auto E = gradient(e);
+    ASSERT_NEAR(E[a], 2420.57, 0.1);
+    ASSERT_NEAR(E[b], 1613.71, 0.1);
+
+    auto s = sin_(a * a);
+    ASSERT_NEAR(gradient(s)[a], -2.61457, 0.001);
+
+    auto c = cos_(a * a);
+    ASSERT_NEAR(gradient(c)[a], 3.0272, 0.001);
+
+    auto l = ln_(a * a);
+    ASSERT_NEAR(gradient(l)[a], 1.0, 0.001);
+
+    auto g = log_(a * a);
+    ASSERT_NEAR(gradient(g)[a], 1.44269504, 0.001);
+
+    var x(3);
+    var y(4);
+    auto p = pow_(x, y);
+    auto P = gradient(p);
+    ASSERT_NEAR(P[x], 108.0, 0.01);
+    ASSERT_NEAR(P[y], 88.9876, 0.01);
+}
+
+TEST(tape, chain_rule_through_functions) {
+    tape t;
+    tape::recording r(t);
+    auto sin_ = autodiff::functions::sin();
+    var x(0.5);
+    auto y = 3 * sin_(x);
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], 3 * std::cos(0.5), 1e-12);
+}
+
+TEST(tape, changing_values) {
+    tape t;
+    tape::recording r(t);
+    var x(10);
+    auto v = x * x - 1;
+    auto w = (1 - x) * x;
+    auto V = gradient(v);
+    auto W = gradient(w);
+    ASSERT_EQ(v.value(), 99);
+    ASSERT_EQ(w.value(), -90);
+    ASSERT_EQ(V[x], 20);
+    ASSERT_EQ(W[x], -19);
+
+    set_value(x, 11);
+    v.forward_pass();
+    w.forward_pass();
+    ASSERT_EQ(v.value(), 120);
+    ASSERT_EQ(w.value(), -110);
+
+    V = gradient(v);
+    W = gradient(w);
+    ASSERT_EQ(V[x], 22);
+    ASSERT_EQ(W[x], -21);
+}
+
+TEST(tape, tree_vars_are_not_recorded) {
+    var a(2);
+    var b(3);
+    auto t = a * b;
+    {
+        tape tp;
+        tape::recording r(tp);
+        ASSERT_THROW(t * 3.0, std::logic_error);
+        ASSERT_THROW(a * b, std::logic_error);
+        var c(4);
+        ASSERT_THROW(c * a, std::logic_error);
+    }
+    ASSERT_EQ(tape::active(), nullptr);
+    // still tree vars once the tape is gone
+    ASSERT_EQ(a.get_tape(), nullptr);
+    ASSERT_EQ(t.get_tape(), nullptr);
+    auto y = t + 1.0;
+    auto Y = gradient(y);
+    ASSERT_EQ(y.value(), 7);
+    ASSERT_EQ(Y[a], 3);
+    ASSERT_EQ(Y[b], 2);
+}
+
+TEST(tape, matches_tree) {
+    auto exp_ = autodiff::functions::exp();
+    var x(2);
+    var y(1);
+    auto z = y / (y + exp_(-x));
+    auto Z = gradient(z);
+
+    tape t;
+    tape::recording r(t);
+    var u(2);
+    var w(1);
+    auto s = w / (w + exp_(-u));
+    auto S = gradient(s);
+    ASSERT_NEAR(s.value(), z.value(), 1e-12);
+    ASSERT_NEAR(S[u], Z[x], 1e-12);
+    ASSERT_NEAR(S[w], Z[y], 1e-12);
+}
+
+TEST(tape, nested_recordings) {
+    tape outer;
+    tape inner;
+    tape::recording r(outer);
+    {
+        tape::recording s(inner);
+        ASSERT_EQ(tape::active(), &inner);
+    }
+    ASSERT_EQ(tape::active(), &outer);
+}
+
+TEST(simplify, identities) {
+    tape t;
+    tape::recording r(t);
+    var x(3);
+    auto y = 0 - (0 - (x * 1 + 0)) * 1 - 0;
+    ASSERT_EQ(t.size(), 13);
+    ASSERT_EQ(t.simplify(y.get_index()), 12);
+    ASSERT_EQ(t.size(), 1);
+    ASSERT_EQ(y.value(), 3);
+    auto Y = gradient(y);
+    ASSERT_EQ(Y[x], 1);
+
+    set_value(x, 5);
+    ASSERT_EQ(y.forward_pass(), 5);
+}
+
+TEST(simplify, folds_constant_subtrees) {
+    tape t;
+    tape::recording r(t);
+    auto exp_ = functions::exp();
+    var k(token(2.0, true), 2.0);
+    var x(3);
+    auto y = exp_(k * 0.5) * x + (k - 2.0) * x;
+    std::size_t before = t.size();
+    std::size_t removed = t.simplify(y.get_index());
+    ASSERT_EQ(t.size(), before - removed);
+    ASSERT_LE(t.size(), 6);
+    ASSERT_NEAR(y.forward_pass(), std::exp(1.0) * 3, 1e-12);
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], std::exp(1.0), 1e-12);
+}
+
+TEST(simplify, merges_constant_chains) {
+    tape t;
+    tape::recording r(t);
+    var x(3);
+    auto y = ((((x * 2.0) * 3.0) * 0.25 + 1.0) - 5.0) + 2.0;
+    ASSERT_EQ(t.simplify(y.get_index()), 8);
+    // x, 1.5, x * 1.5, -2, x * 1.5 + -2
+    ASSERT_EQ(t.size(), 5);
+    ASSERT_NEAR(y.value(), 2.5, 1e-12);
+    auto Y = gradient(y);
+    ASSERT_NEAR(Y[x], 1.5, 1e-12);
+    set_value(x, 1);
+    ASSERT_NEAR(y.forward_pass(), -0.5, 1e-12);
+}
+
+TEST(simplify, matches_unsimplified_gradient) {
+    auto sin_ = functions::sin();
+    auto pow_ = functions::pow();
+    auto model = [&](var& a, var& b) {
+        return sin_(a * 1.0 * b) * 2.0 * 3.0 + (0 - (0 - b)) / (a + 0.0) +
+               pow_(a, b) + 0 - a;
+    };
+    tape plain;
+    var a0(plain, 1.3);
+    var b0(plain, 0.4);
+    auto y0 = model(a0, b0);
+    auto Y0 = gradient(y0);
+
+    tape t;
+    var a(t, 1.3);
+    var b(t, 0.4);
+    auto y = model(a, b);
+    ASSERT_GT(t.simplify(y.get_index()), 0);
+    ASSERT_LT(t.size(), plain.size());
+    auto Y = gradient(y);
+    ASSERT_NEAR(y.value(), y0.value(), 1e-12);
+    ASSERT_NEAR(Y[a], Y0[a0], 1e-12);
+    ASSERT_NEAR(Y[b], Y0[b0], 1e-12);
+
+    // recording goes on after simplifying
+    auto z = y * a;
+    auto Z = gradient(z);
+    ASSERT_NEAR(Z[b], Y0[b0] * 1.3, 1e-12);
+}
+
+TEST(simplify, keeps_every_output) {
+    tape t;
+    tape::recording r(t);
+    var x(2);
+    auto u = x * 1 + 0;
+    auto tmp = x * x;
+    auto w = tmp * 3.0 * 2.0;
+    ASSERT_GT(t.simplify({u.get_index(), w.get_index()}), 0);
+    ASSERT_EQ(u.value(), 2);
+    ASSERT_EQ(w.value(), 24);
+    ASSERT_EQ(gradient(w)[x], 24);
+}
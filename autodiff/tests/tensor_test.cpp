@@ -0,0 +1,265 @@
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+#include "tensor.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace autodiff;
+
+namespace {
+
+const std::vector<double> xs{0.5, 1.25, 2.0, 0.75, 1.5};
+const std::vector<double> ys{1.5, 0.25, 0.5, 2.0, 1.0};
+
+// sum(x y^2 + sin(x) exp(y) + x / y + x^y + ln(x) log(y) + cos(x y))
+template <typename T>
+T model(T& x, T& y);
+
+template <>
+tensor::array model(tensor::array& x, tensor::array& y) {
+    return sum(x * y * y + sin(x) * exp(y) + x / y + pow(x, y) +
+               ln(x) * log(y) + cos(x * y));
+}
+
+}  // namespace
+
+TEST(tensor, matches_scalar_vars) {
+    tensor::array x(xs);
+    tensor::array y(ys);
+    tensor::array f = model(x, y);
+    tensor::gradient G(f);
+
+    auto sin_ = functions::sin();
+    auto cos_ = functions::cos();
+    auto exp_ = functions::exp();
+    auto ln_ = functions::ln();
+    auto log_ = functions::log();
+    auto pow_ = functions::pow();
+    double total = 0;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        base::var a(xs[i]);
+        base::var b(ys[i]);
+        base::var e = a * b * b + sin_(a) * exp_(b) + a / b + pow_(a, b) +
+                      ln_(a) * log_(b) + cos_(a * b);
+        total += e.value();
+        auto g = base::gradient(e);
+        ASSERT_NEAR(G[x][i], g[a], 1e-12) << i;
+        ASSERT_NEAR(G[y][i], g[b], 1e-12) << i;
+    }
+    ASSERT_NEAR(f.value(), total, 1e-12);
+}
+
+TEST(tensor, scalar_operands) {
+    tensor::array x(xs);
+    tensor::array f = sum(2.0 - x * 3.0 + 1.0 / x + pow(x, 3.0) - x / 4.0 +
+                          (x + 1.0) * (-x));
+    tensor::gradient G(f);
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        double v = xs[i];
+        double d = -3 - 1 / (v * v) + 3 * v * v - 0.25 - 2 * v - 1;
+        ASSERT_NEAR(G[x][i], d, 1e-12) << i;
+    }
+}
+
+TEST(tensor, reductions) {
+    tensor::array x(xs);
+    tensor::array y(ys);
+    double d = 0;
+    double n = 0;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        d += xs[i] * ys[i];
+        n += xs[i] * xs[i];
+    }
+    n = std::sqrt(n);
+    tensor::array f = dot(x, y);
+    ASSERT_DOUBLE_EQ(f.value(), d);
+    tensor::array g = norm(x);
+    ASSERT_DOUBLE_EQ(g.value(), n);
+
+    tensor::gradient F(f);
+    tensor::gradient N(g);
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        ASSERT_DOUBLE_EQ(F[x][i], ys[i]);
+        ASSERT_DOUBLE_EQ(F[y][i], xs[i]);
+        ASSERT_DOUBLE_EQ(N[x][i], xs[i] / n);
+    }
+}
+
+TEST(tensor, array_valued_head_sums) {
+    tensor::array x(xs);
+    tensor::array f = x * x;
+    ASSERT_EQ(f.size(), xs.size());
+    ASSERT_THROW(f.value(), std::logic_error);
+    tensor::gradient G(f);
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        ASSERT_DOUBLE_EQ(f[i], xs[i] * xs[i]);
+        ASSERT_DOUBLE_EQ(G[x][i], 2 * xs[i]);
+    }
+}
+
+TEST(tensor, shared_nodes_and_constants) {
+    tensor::array x(xs);
+    tensor::array c = tensor::array::constant(ys);
+    tensor::array u = x * c;
+    tensor::array f = sum(u * u);
+    tensor::gradient G(f);
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        ASSERT_DOUBLE_EQ(G[x][i], 2 * xs[i] * ys[i] * ys[i]);
+        ASSERT_EQ(G[c][i], 0);
+    }
+    tensor::array unrelated(xs);
+    ASSERT_EQ(G[unrelated].size(), xs.size());
+    ASSERT_EQ(G[unrelated][0], 0);
+}
+
+TEST(tensor, forward_pass_after_set_value) {
+    tensor::array x(xs);
+    tensor::array y(ys);
+    tensor::array f = model(x, y);
+    set_value(x, ys);
+    set_value(y, xs);
+    f.forward_pass();
+    tensor::array a(ys);
+    tensor::array b(xs);
+    ASSERT_DOUBLE_EQ(f.value(), model(a, b).value());
+    tensor::gradient G(f);
+    tensor::gradient H(model(a, b));
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        ASSERT_DOUBLE_EQ(G[x][i], H[a][i]);
+    }
+    ASSERT_THROW(set_value(f, xs), std::logic_error);
+    ASSERT_THROW(set_value(x, {1.0}), std::invalid_argument);
+}
+
+TEST(tensor, shapes) {
+    tensor::array m(2, 3, {1, 2, 3, 4, 5, 6});
+    ASSERT_EQ(m.rows(), 2);
+    ASSERT_EQ(m.cols(), 3);
+    tensor::array v({1, 2, 3, 4, 5, 6});
+    ASSERT_EQ(v.rows(), 6);
+    ASSERT_EQ(v.cols(), 1);
+    ASSERT_THROW(m + v, std::invalid_argument);
+    ASSERT_THROW(tensor::array(2, 2, {1, 2, 3}), std::invalid_argument);
+    ASSERT_DOUBLE_EQ(sum(m * m).value(), 91);
+}
+
+namespace {
+
+std::vector<double> filled(std::size_t n, double phase) {
+    std::vector<double> v(n);
+    for (std::size_t i = 0; i < n; ++i) v[i] = std::sin(i * 0.7 + phase);
+    return v;
+}
+
+// c = a b, row-major, by the textbook loop.
+std::vector<double> naive(std::size_t m, std::size_t k, std::size_t n,
+                          const std::vector<double>& a,
+                          const std::vector<double>& b) {
+    std::vector<double> c(m * n, 0.0);
+    for (std::size_t i = 0; i < m; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            for (std::size_t p = 0; p < k; ++p) {
+                c[i * n + j] += a[i * k + p] * b[p * n + j];
+            }
+        }
+    }
+    return c;
+}
+
+// f = sum(w * (a b)) for a m x k, b k x n, checked against the adjoint
+// rules df/da = w b^T and df/db = a^T w.
+void expect_product(std::size_t m, std::size_t k, std::size_t n) {
+    auto av = filled(m * k, 0.1);
+    auto bv = filled(k * n, 0.2);
+    auto wv = filled(m * n, 0.3);
+    tensor::array a(m, k, av);
+    tensor::array b(k, n, bv);
+    tensor::array w = tensor::array::constant(m, n, wv);
+    tensor::array c = matmul(a, b);
+    ASSERT_EQ(c.rows(), m);
+    ASSERT_EQ(c.cols(), n);
+    auto expected = naive(m, k, n, av, bv);
+    for (std::size_t i = 0; i < m * n; ++i) {
+        ASSERT_NEAR(c[i], expected[i], 1e-12) << i;
+    }
+
+    tensor::gradient G(sum(w * c));
+    std::vector<double> bt(n * k);
+    std::vector<double> at(k * m);
+    for (std::size_t p = 0; p < k; ++p) {
+        for (std::size_t j = 0; j < n; ++j) bt[j * k + p] = bv[p * n + j];
+        for (std::size_t i = 0; i < m; ++i) at[p * m + i] = av[i * k + p];
+    }
+    auto da = naive(m, n, k, wv, bt);
+    auto db = naive(k, m, n, at, wv);
+    for (std::size_t i = 0; i < m * k; ++i) {
+        ASSERT_NEAR(G[a][i], da[i], 1e-12) << i;
+    }
+    for (std::size_t i = 0; i < k * n; ++i) {
+        ASSERT_NEAR(G[b][i], db[i], 1e-12) << i;
+    }
+}
+
+}  // namespace
+
+TEST(tensor, matmul) {
+    expect_product(3, 4, 5);
+    // larger than one block in every direction
+    expect_product(70, 300, 530);
+}
+
+TEST(tensor, matvec) {
+    expect_product(7, 9, 1);
+    tensor::array a(2, 3, {1, 2, 3, 4, 5, 6});
+    tensor::array x({1, 0, -1});
+    tensor::array y = matvec(a, x);
+    ASSERT_EQ(y.rows(), 2);
+    ASSERT_DOUBLE_EQ(y[0], -2);
+    ASSERT_DOUBLE_EQ(y[1], -2);
+    ASSERT_THROW(matvec(a, a), std::invalid_argument);
+    ASSERT_THROW(matmul(a, a), std::invalid_argument);
+}
+
+TEST(tensor, transpose) {
+    tensor::array a(2, 3, {1, 2, 3, 4, 5, 6});
+    tensor::array t = transpose(a);
+    ASSERT_EQ(t.rows(), 3);
+    ASSERT_EQ(t.cols(), 2);
+    const double expected[] = {1, 4, 2, 5, 3, 6};
+    for (std::size_t i = 0; i < 6; ++i) ASSERT_DOUBLE_EQ(t[i], expected[i]);
+
+    // sum(t * w) picks out w transposed as the adjoint of a
+    tensor::array w = tensor::array::constant(3, 2, {1, 2, 3, 4, 5, 6});
+    tensor::gradient G(sum(t * w));
+    const double da[] = {1, 3, 5, 2, 4, 6};
+    for (std::size_t i = 0; i < 6; ++i) ASSERT_DOUBLE_EQ(G[a][i], da[i]);
+
+    // a^T a is symmetric
+    tensor::array s = matmul(transpose(a), a);
+    ASSERT_DOUBLE_EQ(s[1], s[3]);
+}
+
+TEST(tensor, parallel_products_agree) {
+    const std::size_t m = 90;
+    const std::size_t k = 40;
+    const std::size_t n = 60;
+    tensor::array a(m, k, filled(m * k, 0.4));
+    tensor::array b(k, n, filled(k * n, 0.5));
+    tensor::array x(filled(k, 0.6));
+    tensor::array c = matmul(a, b);
+    tensor::array y = matvec(a, x);
+    tensor::gradient G(sum(c * c) + sum(y * y));
+    auto da = G[a];
+    auto db = G[b];
+
+    base::thread_pool pool(4);
+    tensor::parallel scope(pool, 0);
+    tensor::array c4 = matmul(a, b);
+    tensor::array y4 = matvec(a, x);
+    for (std::size_t i = 0; i < m * n; ++i) ASSERT_DOUBLE_EQ(c4[i], c[i]);
+    for (std::size_t i = 0; i < m; ++i) ASSERT_DOUBLE_EQ(y4[i], y[i]);
+    tensor::gradient G4(sum(c4 * c4) + sum(y4 * y4));
+    for (std::size_t i = 0; i < m * k; ++i) ASSERT_DOUBLE_EQ(G4[a][i], da[i]);
+    for (std::size_t i = 0; i < k * n; ++i) ASSERT_DOUBLE_EQ(G4[b][i], db[i]);
+}
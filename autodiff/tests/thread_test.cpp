@@ -0,0 +1,105 @@
+#include "arena.hpp"
+#include "gradient.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace autodiff;
+using namespace base;
+
+namespace {
+
+const int threads = 8;
+const int iterations = 200;
+
+// Runs f(thread id) on `threads` threads and returns how many of the
+// calls reported a wrong result.
+template <typename F>
+int run(F f) {
+    std::atomic<int> failures{0};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&failures, &f, i] {
+            for (int j = 0; j < iterations; ++j) {
+                if (!f(i)) ++failures;
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    return failures;
+}
+
+bool check(var& a, var& b, var& c, var& w) {
+    auto W = gradient(w);
+    double x = a.value();
+    double y = b.value();
+    double z = c.value();
+    return W[a] == 2 * (x + y) + z * y && W[b] == 2 * (x + y) + z * x &&
+           W[c] == x * y;
+}
+
+}  // namespace
+
+TEST(threads, independent_trees) {
+    ASSERT_EQ(run([](int i) {
+        var a(i);
+        var b(i + 1);
+        var c(i + 2);
+        auto w = (a + b) * (a + b) + c * a * b;
+        return check(a, b, c, w);
+    }), 0);
+}
+
+TEST(threads, independent_tapes) {
+    ASSERT_EQ(run([](int i) {
+        tape t;
+        tape::recording r(t);
+        var a(i);
+        var b(i + 1);
+        var c(i + 2);
+        auto w = (a + b) * (a + b) + c * a * b;
+        return tape::active() == &t && w.get_tape() == &t &&
+               check(a, b, c, w);
+    }), 0);
+}
+
+TEST(threads, explicit_tapes) {
+    ASSERT_EQ(run([](int i) {
+        tape t;
+        var a(t, i);
+        var b(t, i + 1);
+        var c(t, i + 2);
+        auto w = (a + b) * (a + b) + c * a * b;
+        return tape::active() == nullptr && w.get_tape() == &t &&
+               check(a, b, c, w);
+    }), 0);
+}
+
+TEST(threads, arenas) {
+    ASSERT_EQ(run([](int i) {
+        thread_local arena a;
+        bool ok;
+        {
+            arena::scope s(a);
+            var x(i);
+            var y(i + 1);
+            var z(i + 2);
+            auto w = (x + y) * (x + y) + z * x * y;
+            ok = check(x, y, z, w);
+        }
+        a.reset();
+        return ok;
+    }), 0);
+}
+
+TEST(threads, shared_tape_gradients) {
+    tape t;
+    tape::recording r(t);
+    var a(2);
+    var b(3);
+    var c(5);
+    auto w = (a + b) * (a + b) + c * a * b;
+    ASSERT_EQ(run([&](int) { return check(a, b, c, w); }), 0);
+}
@@ -37,3 +37,30 @@ TEST(token, basic) {
     ASSERT_EQ(t8.is_constant(), false);
 }
 
+TEST(token, opcode) {
+    token t1 = "x";
+    ASSERT_EQ(t1.op(), opcode::variable);
+
+    token t2(2.0, true);
+    ASSERT_EQ(t2.op(), opcode::constant);
+    ASSERT_TRUE(t2.is_constant());
+
+    token t3 = "*";
+    ASSERT_EQ(t3.op(), opcode::mul);
+    ASSERT_TRUE(t3.is_binary_operation());
+    ASSERT_FALSE(t3.is_function());
+
+    token t4 = "0-";
+    ASSERT_EQ(t4.op(), opcode::neg);
+    ASSERT_TRUE(t4.is_function());
+    ASSERT_FALSE(t4.is_variable());
+
+    token t5(opcode::pow);
+    ASSERT_EQ(t5.to_string(), "pow");
+    ASSERT_TRUE(t5.is_function());
+
+    token t6(opcode::sub);
+    ASSERT_EQ(t6.to_string(), "-");
+    ASSERT_TRUE(t6.is_binary_operation());
+    ASSERT_EQ(t6.op(), token("-").op());
+}
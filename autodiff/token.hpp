@@ -3,7 +3,9 @@
 #include <string.h>
 
 #include <algorithm>
+#include <array>
 #include <cctype>
+#include <cstdint>
 #include <iostream>
 #include <list>
 #include <map>
@@ -16,78 +18,131 @@ namespace autodiff {
 const std::vector<std::string> ops = {"(", "^", "-", "+", "*", "/", ")"};
 const std::vector<std::string> fs = {"0-", "exp", "sin", "cos", "log", "ln", "pow"};
 
+// What a token stands for, resolved once when the token is built so the
+// passes over the graph can switch on it instead of comparing strings.
+enum class opcode : std::uint8_t {
+    variable,
+    constant,
+    add,
+    sub,
+    mul,
+    div,
+    neg,
+    exp,
+    sin,
+    cos,
+    ln,
+    log,
+    pow,
+    caret,
+    open_paren,
+    closed_paren,
+    comma
+};
+
 class token {
 public:
-    token(double v, bool is_constant = false) : s_(std::to_string(v)) {
-        is_variable_ = !is_constant;
-        is_constant_ = is_constant;
-        is_binary_operation_ = false;
-    }
+    // Numbers are only formatted when to_string() asks for them, so
+    // building a numeric token never touches the heap. The formatted
+    // string is cached, so print a token shared between threads only
+    // from one of them.
+    token(double v, bool is_constant = false)
+        : number_(v),
+          op_(is_constant ? opcode::constant : opcode::variable) {}
 
-    token(std::string s, bool is_constant = false) : s_(s) {
-        is_binary_operation_ = is_binary_operation();
-        if (is_binary_operation_) {
-            is_variable_ = false;
-            is_constant_ = false;
-        } else {
-            is_variable_ = !is_constant;
-            is_constant_ = is_constant;
-        }
+    token(std::string s, bool is_constant = false) : s_(std::move(s)) {
+        op_ = resolve(s_, is_constant);
     }
 
     token(const char* c_s, bool is_constant = false) : s_(c_s) {
-        is_binary_operation_ = is_binary_operation();
-        if (is_binary_operation_) {
-            is_variable_ = false;
-            is_constant_ = false;
-        } else {
-            is_variable_ = !is_constant;
-            is_constant_ = is_constant;
-        }
+        op_ = resolve(s_, is_constant);
     }
 
+    // Operation tokens keep no string of their own; to_string() hands
+    // out the shared spelling instead.
+    explicit token(opcode op) : op_(op) {}
+
     token(const token& t) {
         s_ = t.s_;
-        is_variable_ = t.is_variable_;
-        is_constant_ = t.is_constant_;
-        is_binary_operation_ = t.is_binary_operation_;
+        number_ = t.number_;
+        op_ = t.op_;
     }
 
     token operator=(const token& t) {
         s_ = t.s_;
-        is_variable_ = t.is_variable_;
-        is_constant_ = t.is_constant_;
-        is_binary_operation_ = t.is_binary_operation_;
+        number_ = t.number_;
+        op_ = t.op_;
         return *this;
     }
 
-    const std::string& to_string() const { return s_; }
+    const std::string& to_string() const {
+        if (s_.empty()) {
+            if (op_ != opcode::variable && op_ != opcode::constant) {
+                return spelling(op_);
+            }
+            s_ = std::to_string(number_);
+        }
+        return s_;
+    }
+
+    opcode op() const { return op_; }
 
-    bool is_binary_operation() {
-        if (std::find(ops.begin(), ops.end(), s_) != ops.end()) {
-            return true;
+    bool is_binary_operation() const {
+        switch (op_) {
+            case opcode::open_paren:
+            case opcode::caret:
+            case opcode::sub:
+            case opcode::add:
+            case opcode::mul:
+            case opcode::div:
+            case opcode::closed_paren:
+                return true;
+            default:
+                return false;
         }
-        return false;
     }
 
-    bool is_function() {
-        if (std::find(fs.begin(), fs.end(), s_) != fs.end()) {
-            return true;
+    bool is_function() const {
+        switch (op_) {
+            case opcode::neg:
+            case opcode::exp:
+            case opcode::sin:
+            case opcode::cos:
+            case opcode::log:
+            case opcode::ln:
+            case opcode::pow:
+                return true;
+            default:
+                return false;
         }
-        return false;
     }
 
-    bool is_constant() { return is_constant_; }
-    bool is_open_paren() { return s_ == "("; }
-    bool is_closed_paren() { return s_ == ")"; }
-    bool is_variable() { return is_variable_; }
-    bool is_comma() { return s_ == ","; }
+    bool is_constant() const { return op_ == opcode::constant; }
+    bool is_open_paren() const { return op_ == opcode::open_paren; }
+    bool is_closed_paren() const { return op_ == opcode::closed_paren; }
+    bool is_variable() const { return op_ == opcode::variable; }
+    bool is_comma() const { return op_ == opcode::comma; }
+
+    static const std::string& spelling(opcode op) {
+        static const std::array<std::string, 17> names = {
+            "",    "",    "+",   "-",   "*",  "/", "0-", "exp", "sin",
+            "cos", "ln",  "log", "pow", "^",  "(", ")",  ","};
+        return names[static_cast<std::size_t>(op)];
+    }
 
 private:
-    std::string s_;
-    bool is_variable_;
-    bool is_constant_;
-    bool is_binary_operation_;
+    static opcode resolve(const std::string& s, bool is_constant) {
+        for (std::size_t i = static_cast<std::size_t>(opcode::add);
+             i <= static_cast<std::size_t>(opcode::comma); ++i) {
+            auto op = static_cast<opcode>(i);
+            if (s == spelling(op)) return op;
+        }
+        return is_constant ? opcode::constant : opcode::variable;
+    }
+
+    mutable std::string s_;
+    double number_ = 0;
+    opcode op_;
 };
 
 }  // namespace autodiff
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <map>
@@ -11,6 +13,9 @@
 #include <utility>
 #include <vector>
 
+#include "arena.hpp"
+#include "cse.hpp"
+#include "tape.hpp"
 #include "token.hpp"
 #include "var.hpp"
 
@@ -19,53 +24,91 @@ namespace base {
 class var {
 public:
     var(const var& v)
-        : t_(v.t_),
-          grad_(0),
+        : grad_(0),
+          t_(v.t_),
           left_(std::move(v.left_)),
           right_(std::move(v.right_)),
-          v_(v.v_) {}
+          terms_(v.terms_),
+          arity_(v.arity_),
+          v_(v.v_),
+          node_(v.node_),
+          tape_(v.tape_),
+          index_(v.index_) {}
     explicit var(std::string s, double v)
-        : t_(s), grad_(0), v_(v) {}
-    explicit var(double v) : t_(v), grad_(0) {
+        : grad_(0), t_(s), v_(v) {
+        enlist();
+    }
+    explicit var(double v) : grad_(0), t_(v) {
+        v_ = v;
+        enlist();
+    }
+    // A variable on an explicitly passed tape, for code that hands its
+    // graph around instead of relying on the thread's active tape.
+    explicit var(tape& t, double v) : grad_(0), t_(v) {
         v_ = v;
+        join(t);
     }
     explicit var(token t)
-        : t_(std::move(t)), grad_(0) {};
+        : grad_(0), t_(std::move(t)) {};
+    // A constant made while recording is a record of the tape, like a
+    // variable.
+    explicit var(token t, double v)
+        : grad_(0), t_(std::move(t)), v_(v) {
+        if (t_.is_constant()) {
+            if (tape* a = tape::active()) join(*a);
+        }
+    }
     explicit var(var&& n)
-        : t_(std::move(n.t_)),
-          grad_(0),
+        : grad_(0),
+          t_(std::move(n.t_)),
           left_(std::move(n.left_)),
           right_(std::move(n.right_)),
-          v_(n.v_) {}
-
-    static std::map<const var*,std::vector<std::shared_ptr<var>>> aliases;
-    
-    friend void update_aliases(const var& l, const var& r, var& result) {
-        if(!(result.left_->is_binary_operation())) {
-            aliases[&l].push_back(result.left_);
-        }
-        if(!(result.right_->is_binary_operation())) {
-            aliases[&r].push_back(result.right_);
+          terms_(std::move(n.terms_)),
+          arity_(n.arity_),
+          v_(n.v_),
+          node_(std::move(n.node_)),
+          tape_(n.tape_),
+          index_(n.index_) {}
+
+    // Releasing the head of a long chain would otherwise destroy it one
+    // nested destructor call per node; nodes this var owns alone are
+    // unlinked here and destroyed one after another instead.
+    ~var() {
+        std::vector<std::shared_ptr<var>> doomed;
+        release(left_, doomed);
+        release(right_, doomed);
+        release(node_, doomed);
+        while (!doomed.empty()) {
+            std::shared_ptr<var> n = std::move(doomed.back());
+            doomed.pop_back();
+            release(n->left_, doomed);
+            release(n->right_, doomed);
+            release(n->node_, doomed);
+            if (n->terms_ && n->terms_.use_count() == 1) {
+                for (auto& t : *n->terms_) release(t, doomed);
+            }
         }
     }
 
     friend void set_value(var& v, double value) { 
-        auto a = aliases[&v];
-        (&v)->v_ = value;
-        (&v)->set_gradient(0); 
-        for(auto& e: a) {
-            e->v_ = value;
-            e->set_gradient(0); 
+        if (v.tape_) {
+            (*v.tape_)[v.tape_->position(v.index_)].value = value;
+        }
+        v.v_ = value;
+        v.set_gradient(0);
+        if (v.node_) {
+            v.node_->v_ = value;
+            v.node_->set_gradient(0);
         }
     }
 
     friend var operator+(const var& l, const var& r) {
-        var result(token(std::string("+")));
-        result.v_ = l.v_.value() + r.v_.value();
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(r);
-        update_aliases(l, r, result);
-        return result;
+        if (tape* t = recording(l, &r)) {
+            return recorded(*t, opcode::add, l.index_, r.index_,
+                            t->value(l.index_) + t->value(r.index_));
+        }
+        return link(opcode::add, l.v_.value() + r.v_.value(), l.node(),
+                    r.node());
     }
 
     friend var operator+(const var& l, const double c) {
@@ -77,60 +120,46 @@ public:
     }
 
     friend var plus_operator(const var& l, const double c) {
-        var result(token(std::string("+")));
-        var right(token(c, true));
-        right.v_ = c;
-        result.v_ = l.v_.value() + c;
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(right);
-        if(!(result.left_->is_binary_operation())) {
-            aliases[&l].push_back(result.left_);
+        if (tape* t = recording(l)) {
+            return recorded(*t, opcode::add, l.index_,
+                            t->push_constant(c), t->value(l.index_) + c);
         }
-        return result;
+        return link(opcode::add, l.v_.value() + c, l.node(), constant(c));
     }
 
     friend var operator-(const var& l, const var& r) {
-        var result(token(std::string("-")));
-        result.v_ = l.v_.value() - r.v_.value();
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(r);
-        update_aliases(l, r, result);
-        return result;
+        if (tape* t = recording(l, &r)) {
+            return recorded(*t, opcode::sub, l.index_, r.index_,
+                            t->value(l.index_) - t->value(r.index_));
+        }
+        return link(opcode::sub, l.v_.value() - r.v_.value(), l.node(),
+                    r.node());
     }
 
     friend var operator-(const var& l, const double c) {
-        var result(token(std::string("-")));
-        var right(token(c, true));
-        right.v_ = c;
-        result.v_ = l.v_.value() - c;
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(right);
-        if(!(result.left_->is_binary_operation())) {
-            aliases[&l].push_back(result.left_);
+        if (tape* t = recording(l)) {
+            return recorded(*t, opcode::sub, l.index_,
+                            t->push_constant(c), t->value(l.index_) - c);
         }
-        return result;
+        return link(opcode::sub, l.v_.value() - c, l.node(), constant(c));
     }
     
     friend var operator-(const double c, const var& r) {
-        var result(token(std::string("-")));
-        var left(token(c, true));
-        left.v_ = c;
-        result.v_ = c - r.v_.value();
-        result.left_ = std::make_shared<var>(left);
-        result.right_ = std::make_shared<var>(r);
-        if(!(result.right_->is_binary_operation())) {
-            aliases[&r].push_back(result.right_);
+        if (tape* t = recording(r)) {
+            tape::index lhs = t->push_constant(c);
+            return recorded(*t, opcode::sub, lhs, r.index_,
+                            c - t->value(r.index_));
         }
-        return result;
+        return link(opcode::sub, c - r.v_.value(), constant(c), r.node());
     }
 
     friend var operator*(const var& l, const var& r) {
-        var result(token(std::string("*")));
-        result.v_ = l.v_.value() * r.v_.value();
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(r);
-        update_aliases(l, r, result);
-        return result;
+        if (tape* t = recording(l, &r)) {
+            return recorded(*t, opcode::mul, l.index_, r.index_,
+                            t->value(l.index_) * t->value(r.index_));
+        }
+        return link(opcode::mul, l.v_.value() * r.v_.value(), l.node(),
+                    r.node());
     }
 
     friend var operator*(const var& l, const double c) {
@@ -142,35 +171,28 @@ public:
     }
 
     friend var mult_operator(const var& l, const double c) {
-        var result(token(std::string("*")));
-        var right(token(c, true));
-        right.v_ = c;
-        result.v_ = c * l.v_.value();
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(right);
-        if(!(result.left_->is_binary_operation())) {
-            aliases[&l].push_back(result.left_);
+        if (tape* t = recording(l)) {
+            return recorded(*t, opcode::mul, l.index_,
+                            t->push_constant(c), c * t->value(l.index_));
         }
-        return result;
+        return link(opcode::mul, c * l.v_.value(), l.node(), constant(c));
     }
 
     friend var operator/(const var& l, const var& r) {
-        var result(token(std::string("/")));
-        result.v_ = l.v_.value() / r.v_.value();
-        result.left_ = std::make_shared<var>(l);
-        result.right_ = std::make_shared<var>(r);
-        update_aliases(l, r, result);
-        return result;
+        if (tape* t = recording(l, &r)) {
+            return recorded(*t, opcode::div, l.index_, r.index_,
+                            t->value(l.index_) / t->value(r.index_));
+        }
+        return link(opcode::div, l.v_.value() / r.v_.value(), l.node(),
+                    r.node());
     }
 
     friend var operator-(const var& v) {
-        var result(token(std::string("0-")));
-        result.v_ = -1 * v.v_.value();
-        result.left_ = std::make_shared<var>(v);
-        if(!(result.left_->is_binary_operation())) {
-            aliases[&v].push_back(result.left_);
+        if (tape* t = recording(v)) {
+            return recorded(*t, opcode::neg, v.index_, 0,
+                            -t->value(v.index_));
         }
-        return result;
+        return link(opcode::neg, -1 * v.v_.value(), v.node());
     }
 
     var operator=(const var& v) {
@@ -178,6 +200,11 @@ public:
         v_ = v.v_;
         left_ = v.left_;
         right_ = v.right_;
+        terms_ = v.terms_;
+        arity_ = v.arity_;
+        node_ = v.node_;
+        tape_ = v.tape_;
+        index_ = v.index_;
         return *this;
     }
 
@@ -192,88 +219,180 @@ public:
     std::shared_ptr<var>& left() { return left_; }
     std::shared_ptr<var>& right() { return right_; }
 
+    // The operands of a fused sum or product, which has no left() or
+    // right(); arity() is 0 for every other node.
+    std::size_t arity() const { return arity_; }
+    std::shared_ptr<var>& term(std::size_t i) { return (*terms_)[i]; }
+
     void clean_grad() {
-        grad_ = 0;
-        if(left_) left_->clean_grad();
-        if(right_) right_->clean_grad();
+        for (var* n : topological_order()) n->grad_ = 0;
     }
 
     token& get_token() { return t_; }
 
     double forward_pass() { 
-        if(t_.to_string() == "+") {
-            v_ = left_->forward_pass() + right_->forward_pass();
-        } else if(t_.to_string() == "*") {
-            v_ = left_->forward_pass() * right_->forward_pass();
-        } else if(t_.to_string() == "-") {
-            v_ = left_->forward_pass() - right_->forward_pass();
-        } else if(t_.to_string() == "/") {
-            v_ = left_->forward_pass() / right_->forward_pass();
-        } else if(t_.to_string() == "exp") {
-            v_ = std::exp(left_->forward_pass());
-        } else if(t_.to_string() == "sin") {
-            v_ = std::sin(left_->forward_pass());
-        } else if(t_.to_string() == "cos") {
-            v_= std::cos(left_->forward_pass());
-        } else if(t_.to_string() == "ln") {
-            v_ = std::log(left_->forward_pass());
-        } else if(t_.to_string() == "log") {
-            v_ = std::log(left_->forward_pass()) / std::log(2);
+        if (tape_) {
+            v_ = tape_->forward(index_);
+            return *v_;
+        }
+        if (node_) {
+            v_ = node_->forward_pass();
+            return *v_;
         }
+        for (var* n : topological_order()) n->evaluate();
 	return value();
     }
 
+    // Recomputes this node's value from its children's current values.
+    void evaluate() {
+        if (arity_) {
+            // left to right, as the chain it replaces would round
+            const auto& terms = *terms_;
+            double v = *terms[0]->v_;
+            if (t_.op() == opcode::add) {
+                for (std::size_t i = 1; i < arity_; ++i) v += *terms[i]->v_;
+            } else {
+                for (std::size_t i = 1; i < arity_; ++i) v *= *terms[i]->v_;
+            }
+            v_ = v;
+            return;
+        }
+        switch (t_.op()) {
+            case opcode::add:
+                v_ = *left_->v_ + *right_->v_;
+                break;
+            case opcode::mul:
+                v_ = *left_->v_ * *right_->v_;
+                break;
+            case opcode::sub:
+                v_ = *left_->v_ - *right_->v_;
+                break;
+            case opcode::div:
+                v_ = *left_->v_ / *right_->v_;
+                break;
+            case opcode::neg:
+                v_ = -*left_->v_;
+                break;
+            case opcode::exp:
+                v_ = std::exp(*left_->v_);
+                break;
+            case opcode::sin:
+                v_ = std::sin(*left_->v_);
+                break;
+            case opcode::cos:
+                v_ = std::cos(*left_->v_);
+                break;
+            case opcode::ln:
+                v_ = std::log(*left_->v_);
+                break;
+            case opcode::log:
+                v_ = std::log(*left_->v_) / std::log(2);
+                break;
+            case opcode::pow:
+                v_ = std::pow(*left_->v_, *right_->v_);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The nodes reachable from this one with children before parents,
+    // each listed once however many parents share it.
+    std::vector<var*> topological_order() {
+        static std::atomic<std::uint64_t> traversals{0};
+        std::vector<var*> order;
+        visit(this, ++traversals, order);
+        return order;
+    }
+
     double value() { 
+        if (tape_) return tape_->value(index_);
 	return v_.value();
     }
 
     double get_gradient() { return grad_; }
     void set_gradient(double grad) { grad_ = grad; }
 
+    // Propagates grad_ back through the graph below this node, visiting
+    // every shared node once, after all of its parents.
     void grad() {
-        if (is_binary_operation()) {
-            auto str = to_string();
-            if (str == "*") {
+        auto order = topological_order();
+        for (auto n = order.rbegin(); n != order.rend(); ++n) {
+            (*n)->propagate();
+        }
+    }
+
+    // Pushes this node's adjoint into its children.
+    void propagate() {
+        switch (t_.op()) {
+            case opcode::mul:
                 multiplication();
-            } else if (str == "+") {
+                break;
+            case opcode::add:
                 addition();
-            } else if (str == "/") {
+                break;
+            case opcode::div:
                 division();
-            } else if (str == "-") {
+                break;
+            case opcode::sub:
                 subtraction();
-            }
-            left()->grad();
-            right()->grad();
-            return;
-        }
-        if (is_function()) {
-            auto str = to_string();
-            if (str == "exp") {
+                break;
+            case opcode::exp:
                 exp();
-            } else if (str == "sin") {
+                break;
+            case opcode::sin:
                 sin();
-            } else if (str == "cos") {
+                break;
+            case opcode::cos:
                 cos();
-            } else if (str == "ln") {
+                break;
+            case opcode::ln:
                 ln();
-            } else if (str == "log") {
+                break;
+            case opcode::log:
                 log();
-            } else if (str == "0-") {
+                break;
+            case opcode::neg:
                 neg();
-            } else if (str == "pow") {
+                break;
+            case opcode::pow:
                 pow();
-            }
-            left()->grad();
-            return;
+                break;
+            default:
+                break;
         }
     }
 
     void addition() {
+        if (arity_) {
+            for (std::size_t i = 0; i < arity_; ++i) {
+                (*terms_)[i]->grad_ += grad_;
+            }
+            return;
+        }
         left_->grad_ += grad_;
         right_->grad_ += grad_;
     }
 
     void multiplication() {
+        if (arity_) {
+            // the product of the terms before each one, then of those
+            // after it, so that zero terms need no special case
+            static thread_local std::vector<double> before;
+            const auto& terms = *terms_;
+            before.resize(arity_);
+            double p = 1;
+            for (std::size_t i = 0; i < arity_; ++i) {
+                before[i] = p;
+                p *= *terms[i]->v_;
+            }
+            double after = grad_;
+            for (std::size_t i = arity_; i-- > 0;) {
+                terms[i]->grad_ += before[i] * after;
+                after *= *terms[i]->v_;
+            }
+            return;
+        }
         left_->grad_ += grad_ * right_->value();
         right_->grad_ += grad_ * left_->value();
     }
@@ -292,9 +411,9 @@ public:
 
     void exp() { left_->grad_ += grad_ * std::exp(left_->value()); }
 
-    void sin() { left_->grad_ += std::cos(left_->value()); }
+    void sin() { left_->grad_ += grad_ * std::cos(left_->value()); }
 
-    void cos() { left_->grad_ -= std::sin(left_->value()); }
+    void cos() { left_->grad_ -= grad_ * std::sin(left_->value()); }
 
     void ln() { left_->grad_ += grad_ * (1 / left_->value()); }
 
@@ -311,56 +430,306 @@ public:
 
     const std::string& to_string() const { return t_.to_string(); }
 
+    // What a gradient is keyed on: the node shared by every copy.
+    const var* identity() const { return node_ ? node_.get() : this; }
+
+    tape* get_tape() const { return tape_; }
+    tape::index get_index() const { return index_; }
+
+    // Copies v into a new tree node, carved out of the active arena if
+    // there is one on this thread.
+    static std::shared_ptr<var> make_node(const var& v) {
+        if (arena* a = arena::active()) {
+            return std::allocate_shared<var>(arena_allocator<var>(*a), v);
+        }
+        return std::make_shared<var>(v);
+    }
+
+    // The node this var contributes to an expression. Variables and
+    // operation results own one node that every copy shares, so a reused
+    // subexpression is a single node of the DAG and adjoints accumulate
+    // straight into it; anything else is copied into a fresh node.
+    std::shared_ptr<var> node() const {
+        if (node_) return node_;
+        return make_node(*this);
+    }
+
+    // Creates the node for op over the given children and returns the
+    // var standing for it. With a cse table active, an identical live
+    // node is reused instead.
+    static var link(opcode op, double value, std::shared_ptr<var> l,
+                    std::shared_ptr<var> r = nullptr) {
+        cse* table = sharing();
+        if (!table && r && (op == opcode::add || op == opcode::mul) &&
+            l->t_.op() == op && l.use_count() == 2) {
+            return fuse(op, value, *l, std::move(r));
+        }
+        shape s;
+        if (table) {
+            s = shape::of(op, reinterpret_cast<std::uintptr_t>(l.get()),
+                          reinterpret_cast<std::uintptr_t>(r.get()));
+            if (auto n = table->find(s)) {
+                var result(token(op), n->v_.value());
+                result.left_ = n->left_;
+                result.right_ = n->right_;
+                result.node_ = std::move(n);
+                return result;
+            }
+        }
+        var result(token(op), value);
+        result.left_ = std::move(l);
+        result.right_ = std::move(r);
+        result.node_ = make_node(result);
+        if (table) table->insert(s, result.node_);
+        return result;
+    }
+
+    // Extends the sum or product l by one more operand r as a single
+    // n-ary node, so that a chain like s = s + x[i] neither nests nor
+    // keeps a node per link. link() only fuses when l is held by nothing
+    // but its operand and the call itself, so no other node, r included,
+    // can reach it. Nodes of one chain share their list of terms, each
+    // seeing the prefix it was built with; the list grows in place only
+    // while l and its operand are all that see it, and is copied
+    // otherwise, so it never comes to hold a node that holds it.
+    static var fuse(opcode op, double value, var& l, std::shared_ptr<var> r) {
+        var result(token(op), value);
+        if (l.arity_ && l.arity_ == l.terms_->size() &&
+            l.terms_.use_count() == 2) {
+            result.terms_ = l.terms_;
+        } else if (l.arity_) {
+            result.terms_ = std::make_shared<std::vector<std::shared_ptr<var>>>(
+                l.terms_->begin(), l.terms_->begin() + l.arity_);
+        } else {
+            result.terms_ = std::make_shared<std::vector<std::shared_ptr<var>>>(
+                std::initializer_list<std::shared_ptr<var>>{l.left_,
+                                                            l.right_});
+        }
+        result.terms_->push_back(std::move(r));
+        result.arity_ = result.terms_->size();
+        result.node_ = make_node(result);
+        return result;
+    }
+
+    // The active cse table, if any. Its entries hold weak references into
+    // the nodes' control blocks, which an arena would reuse after
+    // reset(), so the two cannot be active together.
+    static cse* sharing() {
+        cse* table = cse::active();
+        if (table && arena::active()) {
+            throw std::logic_error(
+                "autodiff: a cse table and an arena are both active");
+        }
+        return table;
+    }
+
+    static std::shared_ptr<var> constant(double c) {
+        cse* table = sharing();
+        if (!table) return make_node(var(token(c, true), c));
+        if (auto n = table->find(shape::of(c))) return n;
+        auto n = make_node(var(token(c, true), c));
+        table->insert(shape::of(c), n);
+        return n;
+    }
+
+    // Returns the tape an operation on l (and r) is recorded on, or
+    // nullptr in tree mode. Every operand must already live on that
+    // tape: a tree var has no record to refer to, and giving it one here
+    // would tie it to a tape it may outlive.
+    static tape* recording(const var& l, const var* r = nullptr) {
+        tape* t = tape::active();
+        if (!t) t = l.tape_ ? l.tape_ : (r ? r->tape_ : nullptr);
+        if (!t) return nullptr;
+        l.recorded_on(*t);
+        if (r) r->recorded_on(*t);
+        return t;
+    }
+
+    // The var standing for index i of t, e.g. of a tape loaded from a
+    // file; nothing is recorded.
+    static var on(tape& t, tape::index i) {
+        const record& r = t[t.position(i)];
+        var result(r.op == opcode::variable || r.op == opcode::constant
+                       ? token(r.value, r.op == opcode::constant)
+                       : token{r.op});
+        result.v_ = r.value;
+        result.tape_ = &t;
+        result.index_ = i;
+        return result;
+    }
+
+    static var recorded(tape& t, opcode op, tape::index lhs, tape::index rhs,
+                        double value) {
+        var result(token{op});
+        result.v_ = value;
+        result.tape_ = &t;
+        result.index_ = t.push(op, lhs, rhs, value);
+        return result;
+    }
+
     double grad_;
 
 private:
+    // Depth-first with an explicit stack, so the depth of the graph is
+    // bounded by the heap rather than the native stack; the stack is kept
+    // per thread between traversals. Each traversal stamps the nodes it
+    // reaches with its own number, so no visited set has to be allocated.
+    // A node is emitted once all of its children are.
+    static void visit(var* root, std::uint64_t traversal,
+                      std::vector<var*>& order) {
+        // the node and how many of its children have been descended into
+        static thread_local std::vector<std::pair<var*, std::size_t>> stack;
+        if (root->visited_ == traversal) return;
+        root->visited_ = traversal;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            auto& [n, next] = stack.back();
+            var* child = nullptr;
+            if (n->arity_) {
+                if (next == n->arity_) {
+                    order.push_back(n);
+                    stack.pop_back();
+                    continue;
+                }
+                child = (*n->terms_)[next].get();
+            } else if (next == 0) {
+                child = n->left_.get();
+            } else if (next == 1) {
+                child = n->right_.get();
+            } else {
+                order.push_back(n);
+                stack.pop_back();
+                continue;
+            }
+            ++next;
+            if (child && child->visited_ != traversal) {
+                child->visited_ = traversal;
+                stack.emplace_back(child, 0);
+            }
+        }
+    }
+
+    static void release(std::shared_ptr<var>& p,
+                        std::vector<std::shared_ptr<var>>& doomed) {
+        bool linked = p && (p->left_ || p->right_ || p->terms_ || p->node_);
+        if (linked && p.use_count() == 1) {
+            doomed.push_back(std::move(p));
+        } else {
+            p.reset();
+        }
+    }
+
+    // Gives a new variable its identity: a tape slot while recording,
+    // otherwise the node all of its copies share. That node is always
+    // heap allocated so a long-lived variable survives arena resets.
+    void enlist() {
+        if (!t_.is_variable()) return;
+        if (tape* t = tape::active()) {
+            join(*t);
+        } else {
+            node_ = std::make_shared<var>(*this);
+        }
+    }
+
+    void join(tape& t) {
+        tape_ = &t;
+        index_ = t_.is_constant() ? t.push_constant(v_.value())
+                                  : t.push_variable(v_.value());
+    }
+
+    void recorded_on(const tape& t) const {
+        if (!tape_) {
+            throw std::logic_error(
+                "autodiff: tree var used while recording; create it on the "
+                "tape");
+        }
+        if (tape_ != &t) {
+            throw std::logic_error("autodiff: operands live on different tapes");
+        }
+    }
+
     token t_;
     std::shared_ptr<var> left_;
     std::shared_ptr<var> right_;
+    std::shared_ptr<std::vector<std::shared_ptr<var>>> terms_;
+    std::size_t arity_ = 0;
     std::optional<double> v_;
+    std::shared_ptr<var> node_;
+    std::uint64_t visited_ = 0;
+    tape* tape_ = nullptr;
+    tape::index index_ = 0;
 };
 
-std::map<const var*,std::vector<std::shared_ptr<var>>> var::aliases;
-
 }  // namespace base
 
+namespace detail {
+
+// The elementary functions for number types other than var. Their
+// overloads live next to the type and are found by argument-dependent
+// lookup, which lets the functions:: functors accept any of them.
+template <typename T>
+auto call_exp(const T& x) -> decltype(exp(x)) { return exp(x); }
+template <typename T>
+auto call_sin(const T& x) -> decltype(sin(x)) { return sin(x); }
+template <typename T>
+auto call_cos(const T& x) -> decltype(cos(x)) { return cos(x); }
+template <typename T>
+auto call_ln(const T& x) -> decltype(ln(x)) { return ln(x); }
+template <typename T>
+auto call_log(const T& x) -> decltype(log(x)) { return log(x); }
+template <typename X, typename Y>
+auto call_pow(const X& x, const Y& y) -> decltype(pow(x, y)) {
+    return pow(x, y);
+}
+
+}  // namespace detail
+
 namespace functions {
 
+using autodiff::opcode;
+using autodiff::base::tape;
 using autodiff::base::var;
 
 struct pow {
     pow() {}
     var operator()(var& x, var& y) {
-        var result("pow", std::pow(x.value(), y.value()));
-        result.set_left(std::make_shared<var>(x));
-        result.set_right(std::make_shared<var>(y));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&x].push_back(result.left());
-        }
-        if(!(result.right()->is_binary_operation())) {
-            var::aliases[&y].push_back(result.right());
+        if (tape* t = var::recording(x, &y)) {
+            return var::recorded(*t, opcode::pow, x.get_index(),
+                                 y.get_index(),
+                                 std::pow(t->value(x.get_index()),
+                                          t->value(y.get_index())));
         }
-        return result;
+        return var::link(opcode::pow, std::pow(x.value(), y.value()), x.node(),
+                         y.node());
+    }
+
+    template <typename X, typename Y>
+    auto operator()(const X& x, const Y& y)
+        -> decltype(detail::call_pow(x, y)) {
+        return detail::call_pow(x, y);
     }
 };
 
 struct exp {
     exp() {}
     var operator()(var& e) {
-        var result("exp", std::exp(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::exp, e.get_index(), 0,
+                                 std::exp(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::exp, std::exp(e.value()), e.node());
     }
     var operator()(var&& e) {
-        var result("exp", std::exp(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::exp, e.get_index(), 0,
+                                 std::exp(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::exp, std::exp(e.value()), e.node());
+    }
+
+    template <typename T>
+    auto operator()(const T& e) -> decltype(detail::call_exp(e)) {
+        return detail::call_exp(e);
     }
 };
 
@@ -368,20 +737,23 @@ struct sin {
     sin() {}
 
     var operator()(var& e) {
-        var result("sin", std::sin(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::sin, e.get_index(), 0,
+                                 std::sin(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::sin, std::sin(e.value()), e.node());
     }
     var operator()(var&& e) {
-        var result("sin", std::sin(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::sin, e.get_index(), 0,
+                                 std::sin(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::sin, std::sin(e.value()), e.node());
+    }
+
+    template <typename T>
+    auto operator()(const T& e) -> decltype(detail::call_sin(e)) {
+        return detail::call_sin(e);
     }
 };
 
@@ -389,20 +761,23 @@ struct cos {
     cos() {}
 
     var operator()(var& e) {
-        var result("cos", std::cos(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::cos, e.get_index(), 0,
+                                 std::cos(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::cos, std::cos(e.value()), e.node());
     }
     var operator()(var&& e) {
-        var result("cos", std::cos(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::cos, e.get_index(), 0,
+                                 std::cos(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::cos, std::cos(e.value()), e.node());
+    }
+
+    template <typename T>
+    auto operator()(const T& e) -> decltype(detail::call_cos(e)) {
+        return detail::call_cos(e);
     }
 };
 
@@ -410,20 +785,23 @@ struct ln {
     ln() {}
 
     var operator()(var& e) {
-        var result("ln", std::log(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::ln, e.get_index(), 0,
+                                 std::log(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::ln, std::log(e.value()), e.node());
     }
     var operator()(var&& e) {
-        var result("ln", std::log(e.value()));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::ln, e.get_index(), 0,
+                                 std::log(t->value(e.get_index())));
         }
-        return result;
+        return var::link(opcode::ln, std::log(e.value()), e.node());
+    }
+
+    template <typename T>
+    auto operator()(const T& e) -> decltype(detail::call_ln(e)) {
+        return detail::call_ln(e);
     }
 };
 
@@ -431,20 +809,25 @@ struct log {
     log() {}
 
     var operator()(var& e) {
-        var result("log", std::log(e.value()) / std::log(2));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::log, e.get_index(), 0,
+                                 std::log(t->value(e.get_index())) / std::log(2));
         }
-        return result;
+        return var::link(opcode::log, std::log(e.value()) / std::log(2),
+                         e.node());
     }
     var operator()(var&& e) {
-        var result("log", std::log(e.value()) / std::log(2));
-        result.set_left(std::make_shared<var>(e));
-        if(!(result.left()->is_binary_operation())) {
-            var::aliases[&e].push_back(result.left());
+        if (tape* t = var::recording(e)) {
+            return var::recorded(*t, opcode::log, e.get_index(), 0,
+                                 std::log(t->value(e.get_index())) / std::log(2));
         }
-        return result;
+        return var::link(opcode::log, std::log(e.value()) / std::log(2),
+                         e.node());
+    }
+
+    template <typename T>
+    auto operator()(const T& e) -> decltype(detail::call_log(e)) {
+        return detail::call_log(e);
     }
 };
 
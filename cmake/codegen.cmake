@@ -0,0 +1,19 @@
+# Builds the shared library `_name` from the C++ source that the
+# executable target `_generator` writes, typically with
+# autodiff::codegen::generate(), to the path given as its only argument.
+# The source is generated again whenever the generator changes.
+function(autodiff_generated_library _name _generator)
+    set(_source ${CMAKE_CURRENT_BINARY_DIR}/${_name}.cpp)
+    add_custom_command(
+        OUTPUT
+            ${_source}
+        COMMAND
+            ${_generator} ${_source}
+        DEPENDS
+            ${_generator}
+        COMMENT
+            "Generating ${_name}.cpp"
+        VERBATIM
+        )
+    add_library(${_name} SHARED ${_source})
+endfunction()